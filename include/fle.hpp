@@ -1,8 +1,12 @@
 #pragma once
 #include "nlohmann/json.hpp"
+#include <algorithm>
 #include <cstdint>
 #include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -14,8 +18,18 @@ enum class RelocationType {
     R_X86_64_PC32, // 32位相对寻址
     R_X86_64_64, // 64位绝对寻址
     R_X86_64_32S, // 32位有符号绝对寻址
+    R_X86_64_GOTPCREL, // 32位相对寻址，经由 GOT 表项
+    R_X86_64_GOTPCRELX, // 同上，指令可被松弛（relax）
+    R_X86_64_REX_GOTPCRELX, // 同上，带 REX 前缀的指令
 };
 
+// PC 相对的重定位类型（.rel 与 GOT 类），其余为绝对寻址
+constexpr bool is_pc_relative(RelocationType type)
+{
+    return type == RelocationType::R_X86_64_PC32 || type == RelocationType::R_X86_64_GOTPCREL
+        || type == RelocationType::R_X86_64_GOTPCRELX || type == RelocationType::R_X86_64_REX_GOTPCRELX;
+}
+
 // 重定位项
 struct Relocation {
     RelocationType type;
@@ -35,11 +49,18 @@ enum class SymbolType {
 struct Symbol {
     SymbolType type;
     std::string section; // 符号所在的节名
-    size_t offset; // 在节内的偏移
+    size_t offset; // 在节内的偏移（.exe 中为绝对地址）
     size_t size; // 符号大小
     std::string name; // 符号名称
 };
 
+// 可执行文件的地址索引项：[start, end) 属于 symbols[symbol]，按 start 排序
+struct SymbolIndexEntry {
+    uint64_t start;
+    uint64_t end;
+    size_t symbol;
+};
+
 // FLE memory structure
 struct FLESection {
     std::vector<uint8_t> data; // Raw data
@@ -60,6 +81,12 @@ enum class SHF { // Section Header Flags
     NOBITS = 8, // 不占用文件空间（如BSS）
 };
 
+// BSS 类节：.bss、.bss.*，以及 -mcmodel=medium 的大数据节 .lbss、.lbss.*
+inline bool is_bss_section(std::string_view name)
+{
+    return name == ".bss" || name.starts_with(".bss.") || name == ".lbss" || name.starts_with(".lbss.");
+}
+
 struct SectionHeader {
     std::string name; // 节名
     uint32_t type; // 节类型
@@ -73,8 +100,23 @@ struct SectionHeader {
 struct ProgramHeader {
     std::string name; // 段名
     uint64_t vaddr; // 虚拟地址（改用64位）
-    uint32_t size; // 段大小
+    uint64_t size; // 段大小
     uint32_t flags; // 权限
+    uint64_t align = 0x1000; // 段对齐，大页代码段为 2 MiB
+};
+
+// COMDAT 节组：签名相同的组在链接时只保留一份
+struct SectionGroup {
+    std::string signature; // 组签名（通常是组内定义的符号名）
+    std::vector<std::string> sections; // 组内的节名
+};
+
+// --pie 链接的可执行文件里存放绝对地址的位置（链接时地址，升序），
+// 加载到其他基址时给每处加上相同的偏移
+struct DynamicRelocs {
+    std::vector<uint64_t> abs64; // 8 字节绝对地址：R_X86_64_64、GOT 表项与跳板目标
+    std::vector<uint64_t> abs32; // R_X86_64_32，零扩展
+    std::vector<uint64_t> abs32s; // R_X86_64_32S，符号扩展
 };
 
 struct FLEObject {
@@ -84,9 +126,24 @@ struct FLEObject {
     std::vector<Symbol> symbols; // Global symbol table
     std::vector<ProgramHeader> phdrs; // Program headers (for .exe)
     std::vector<SectionHeader> shdrs; // Section headers
+    std::vector<SectionGroup> groups; // COMDAT section groups (for .obj)
+    std::vector<SymbolIndexEntry> symbol_index; // Sorted address index into symbols (for .exe)
+    std::string build_id; // Hex digest of the final layout and section contents (for .exe)
     size_t entry = 0; // Entry point (for .exe)
+    std::optional<DynamicRelocs> dynamic_relocs; // Load-time fixups, present when linked with --pie (for .exe)
 };
 
+// 在可执行文件的地址索引中二分查找包含 addr 的符号，找不到返回 nullptr
+inline const Symbol* find_symbol_by_address(const FLEObject& exe, uint64_t addr)
+{
+    auto it = std::upper_bound(exe.symbol_index.begin(), exe.symbol_index.end(), addr,
+        [](uint64_t value, const SymbolIndexEntry& entry) { return value < entry.start; });
+    if (it == exe.symbol_index.begin() || addr >= std::prev(it)->end) {
+        return nullptr;
+    }
+    return &exe.symbols[std::prev(it)->symbol];
+}
+
 class FLEWriter {
 public:
     void set_type(std::string_view type)
@@ -129,6 +186,7 @@ public:
             phdr_json["vaddr"] = phdr.vaddr;
             phdr_json["size"] = phdr.size;
             phdr_json["flags"] = phdr.flags;
+            phdr_json["align"] = phdr.align;
             phdrs_json.push_back(phdr_json);
         }
         result["phdrs"] = phdrs_json;
@@ -156,6 +214,54 @@ public:
         result["shdrs"] = shdrs_json;
     }
 
+    // .exe 的符号表不内嵌在节内容中，单独存放绝对地址
+    void write_build_id(const std::string& build_id)
+    {
+        result["build_id"] = build_id;
+    }
+
+    void write_dynamic_relocs(const DynamicRelocs& relocs)
+    {
+        result["dynamic_relocs"] = { { "abs64", relocs.abs64 }, { "abs32", relocs.abs32 }, { "abs32s", relocs.abs32s } };
+    }
+
+    void write_symbols(const std::vector<Symbol>& symbols)
+    {
+        json symbols_json = json::array();
+        for (const auto& sym : symbols) {
+            json sym_json;
+            sym_json["name"] = sym.name;
+            sym_json["type"] = sym.type == SymbolType::LOCAL ? "local" : sym.type == SymbolType::WEAK ? "weak"
+                                                                                                      : "global";
+            sym_json["section"] = sym.section;
+            sym_json["addr"] = sym.offset;
+            sym_json["size"] = sym.size;
+            symbols_json.push_back(sym_json);
+        }
+        result["symbols"] = symbols_json;
+    }
+
+    void write_symbol_index(const std::vector<SymbolIndexEntry>& index)
+    {
+        json index_json = json::array();
+        for (const auto& entry : index) {
+            index_json.push_back(json::array({ entry.start, entry.end, entry.symbol }));
+        }
+        result["symbol_index"] = index_json;
+    }
+
+    void write_groups(const std::vector<SectionGroup>& groups)
+    {
+        json groups_json = json::array();
+        for (const auto& group : groups) {
+            json group_json;
+            group_json["signature"] = group.signature;
+            group_json["sections"] = group.sections;
+            groups_json.push_back(group_json);
+        }
+        result["groups"] = groups_json;
+    }
+
 private:
     std::string current_section;
     nlohmann::ordered_json result;
@@ -164,7 +270,97 @@ private:
 
 // Core functions that we provide
 FLEObject load_fle(const std::string& filename); // Load FLE file into memory
+FLEObject load_elf(const std::string& filename); // Load ELF64 relocatable object into memory
+bool is_elf_file(const std::string& filename); // Check for the ELF magic number
 void FLE_cc(const std::vector<std::string>& args); // Compile source files to FLE
+FLEObject load_object(const std::string& filename); // Load an FLE file or ELF64 relocatable object
+void FLE_write_elf(const FLEObject& obj, const std::string& filename); // Write an .exe as a static ELF64 executable
+
+// 按需读取的 ELF64 可重定位目标文件：打开时只读头部、符号表、节组和重定位，
+// 节内容用到时才读。load_elf 建立在它之上，ld --stream 用它控制内存峰值
+class ElfObjectReader {
+public:
+    explicit ElfObjectReader(const std::string& filename);
+
+    const FLEObject& object() const { return obj; } // 各节的 data 为空，relocs 与 bss_size 已填好
+    uint64_t section_size(const std::string& name) const;
+    // 读出节内 [offset, offset + size) 的内容，重定位字段与 load_elf 一样清零
+    std::vector<uint8_t> read(const std::string& name, uint64_t offset, uint64_t size);
+
+private:
+    struct Extent {
+        uint64_t offset; // 节内容在文件中的偏移
+        uint64_t size; // 节内容长度，BSS 节为 0
+        std::vector<std::pair<uint64_t, uint8_t>> fields; // 按偏移排序的重定位字段 (偏移, 长度)
+    };
+
+    std::string read_raw(uint64_t offset, uint64_t size);
+
+    std::string filename;
+    std::ifstream in;
+    FLEObject obj;
+    std::map<std::string, Extent> extents;
+};
+
+// ELF 段在输出文件中的位置，与 FLEObject::phdrs 一一对应
+struct ElfSegment {
+    uint64_t offset;
+    uint64_t filesz;
+};
+// 只写出 ELF 头、程序头与节头，段内容由调用者按返回的位置写入
+std::vector<ElfSegment> write_elf_headers(const FLEObject& obj, std::ostream& out);
+void mark_executable(const std::string& filename);
+
+// 布局文件（链接脚本子集，见 layout.cpp）：输出节的顺序、对齐、权限与输入节映射
+struct InputSectionRule {
+    std::string file; // 目标文件名通配符
+    std::vector<std::string> sections; // 输入节名通配符
+};
+
+struct OutputSectionRule {
+    std::string name;
+    std::vector<InputSectionRule> inputs;
+    uint64_t align = 0; // 段对齐，0 表示默认（一页，--hugepage-text 的代码段为 2 MiB）
+    uint64_t subalign = 0; // 输入节在输出节内的对齐，0 表示紧密排列
+    std::optional<uint32_t> flags; // PHF 权限，缺省时按节名推断
+};
+
+struct LinkLayout {
+    std::optional<uint64_t> base; // 缺省为 0x400000
+    std::vector<OutputSectionRule> sections;
+};
+
+LinkLayout load_layout(const std::string& filename);
+
+// 链接选项
+struct LinkOptions {
+    unsigned threads = 0; // 符号解析的工作线程数，0 表示使用硬件并发数
+    std::string reloc_cache; // 链接计划缓存文件，为空表示不缓存
+    bool hugepage_text = false; // 代码段按 2 MiB 对齐，便于用大页映射
+    bool discard_locals = false; // 输出的符号表中不含局部符号
+    bool pie = false; // 保留绝对地址的动态重定位表，加载器可以把映像放到任意基址
+    LinkLayout layout; // --layout 给出的布局，未匹配的输入节按默认规则各自成节
+};
+
+// ld 命令行
+struct LdCommand {
+    std::string outfile = "a.out";
+    std::string format = "fle"; // fle 或 elf
+    LinkOptions options;
+    bool stream = false; // 流式链接（仅 ELF 输出）
+    bool plan = false; // 只规划并报告布局，不写输出
+    bool run = false; // 链接结果不落盘，直接交给加载器在本进程中运行
+    std::vector<std::string> inputs;
+};
+
+// 加载器返回共享的只读对象，常驻的链接服务可以把缓存中的对象直接交给链接器而不复制
+using ObjectLoader = std::function<std::shared_ptr<const FLEObject>(const std::string&)>;
+LdCommand parse_ld_args(const std::vector<std::string>& args);
+void run_ld(const LdCommand& command, const ObjectLoader& load); // Load inputs through `load`, link and write the output
+
+// 常驻链接服务：在 Unix 域套接字上接受链接请求，按路径与修改时间缓存已解析的目标文件
+int FLE_ld_server(const std::string& socket_path);
+int FLE_ld_connect(const std::string& socket_path, const std::vector<std::string>& args);
 
 // Functions for students to implement
 /**
@@ -192,16 +388,158 @@ void FLE_objdump(const FLEObject& obj, FLEWriter& writer);
  */
 void FLE_nm(const FLEObject& obj);
 
+// exec 选项
+struct ExecOptions {
+    bool loader_stats = false; // 在 stderr 报告映像区间与加载器的系统调用次数
+    std::optional<std::string> profile; // 采样分析，折叠栈写到这个文件（仅 FLE 可执行文件）
+    std::optional<std::string> perf_counters; // 统计性能计数器，JSON 写到这个文件，空串表示 stderr
+    bool syscall_stats = false; // 在 ptrace 下运行，统计各系统调用的次数、耗时与调用点
+    bool relocate = false; // ld --pie 的映像不用链接时的地址，放到内核挑选的基址
+};
+
 /**
  * Execute an FLE executable file
  * @param obj The FLE executable object
+ * @param options Loader options (see ExecOptions)
  * @throws runtime_error if the file is not executable or _start symbol is not found
  */
-void FLE_exec(const FLEObject& obj);
+void FLE_exec(const FLEObject& obj, const ExecOptions& options = {});
+
+/**
+ * Run a static ELF executable written by `ld --format=elf`
+ * @param filename Path of the executable
+ *
+ * PT_LOAD segments are mapped straight from the file (MAP_PRIVATE), so
+ * startup does not copy the image and concurrent runs share page-cache pages.
+ * Like FLE_exec, the whole image range is reserved with one mapping first.
+ */
+void FLE_exec_elf(const std::string& filename, const ExecOptions& options = {});
+
+/**
+ * Save the loaded image of an FLE executable as a snapshot
+ * @param filename Path of the FLE executable
+ * @param path Snapshot file to write
+ * @param options Loader options (see ExecOptions); with `relocate` the
+ *        snapshot records the relocated addresses
+ *
+ * The image is mapped and relocated in this process, then every segment is
+ * written page-aligned together with its final permissions and the entry.
+ * The header also records the executable's absolute path, size, mtime and
+ * inode, and executables linked with --pie keep their dynamic relocations.
+ */
+void FLE_write_snapshot(const std::string& filename, const std::string& path, const ExecOptions& options = {});
+
+/**
+ * Run a snapshot written by FLE_write_snapshot
+ * @param filename Path of the snapshot
+ *
+ * Segments are mapped straight from the file (MAP_PRIVATE) at the recorded
+ * addresses, so startup costs a handful of system calls however large the
+ * initialized data is. The snapshot is rejected when its executable has
+ * changed since it was taken. If the recorded range is occupied, a snapshot
+ * with dynamic relocations is moved elsewhere and fixed up; one without
+ * them is rejected.
+ */
+void FLE_exec_snapshot(const std::string& filename, const ExecOptions& options = {});
+
+/**
+ * Map an FLE or ELF executable into the current process without running it
+ * @param filename Path of the executable
+ * @param options Loader options (see ExecOptions)
+ * @return The entry address
+ */
+uint64_t FLE_load_exec(const std::string& filename, const ExecOptions& options = {});
+
+// 映射在当前进程中的 FLE 映像
+struct LoadedImage {
+    uint64_t entry; // 入口的实际地址
+    uint64_t start; // 映像实际占用的区间 [start, end)
+    uint64_t end;
+};
+
+/**
+ * Map an FLE executable into the current process next to other images
+ * @param obj The FLE executable; only images linked with --pie can move off
+ *        their link-time addresses
+ * @param options Loader options (see ExecOptions)
+ * @param syscall_hook If nonzero, the program's syscall() is patched to jump
+ *        here, so a host can serve its system calls in-process
+ * @return Where the image landed; release it with FLE_unmap_image
+ */
+LoadedImage FLE_map_image(const FLEObject& obj, const ExecOptions& options, uint64_t syscall_hook = 0);
+void FLE_unmap_image(const LoadedImage& image);
+
+/**
+ * Batch host: run many FLE programs inside this process on a thread pool
+ * @param files The executables, each linked with --pie; a file may repeat
+ * @param threads Number of worker threads, 0 for the hardware concurrency
+ * @param options Loader options (see ExecOptions)
+ * @return 0 if every program exited with status 0, 1 otherwise
+ *
+ * Every run gets its own copy of the image. write() to stdout/stderr is
+ * captured per program, stdin reads as empty, and exit or a fault ends only
+ * that program. Outputs and statuses are reported in argument order.
+ */
+int FLE_exec_batch(const std::vector<std::string>& files, unsigned threads, const ExecOptions& options = {});
+
+/**
+ * Fork server: map the executable once, then fork a child per request that
+ * jumps straight to the entry point
+ * @param filename Path of the executable
+ * @param socket_path Unix socket to accept requests on; if empty, every line
+ *        read from stdin is one request and becomes the child's stdin
+ * @param options Loader options (see ExecOptions)
+ *
+ * Exit status and wall time of every run are reported, so per-run latency
+ * is roughly the cost of a fork instead of parsing and mapping the image.
+ */
+int FLE_exec_server(const std::string& filename, const std::string& socket_path, const ExecOptions& options = {});
+int FLE_exec_connect(const std::string& socket_path, bool shutdown); // Send stdin as one request, print the child's output
+
+/**
+ * Run a program under the sampling profiler
+ * @param exe The FLE executable, used to symbolize samples
+ * @param folded_path Where to write the folded stacks (one "root;...;leaf count" per line)
+ * @param load Called in the child to map the image; returns the entry address
+ * @return Exit status of the program
+ *
+ * The program runs in a child with an ITIMER_PROF sampler; the parent drains
+ * the samples from a shared ring buffer and prints a flat profile by symbol
+ * and section to stderr after the child exits.
+ */
+int FLE_profile(const FLEObject& exe, const std::string& folded_path, const std::function<uint64_t()>& load);
+
+/**
+ * Run a program with performance counters attached
+ * @param program Name reported in the JSON output
+ * @param output File to write the JSON report to; stderr if empty
+ * @param load Called in the child to map the image; returns the entry address
+ * @return Exit status of the program
+ *
+ * Counters (cycles, instructions, task clock, page faults, context switches)
+ * are opened with perf_event_open on the child and enabled right before it
+ * jumps to the entry point. Hardware counters that the machine does not
+ * expose are reported as null; without perf_event_open at all the software
+ * numbers come from the child's rusage.
+ */
+int FLE_perf_counters(const std::string& program, const std::string& output, const std::function<uint64_t()>& load);
+
+/**
+ * Run a program under a ptrace supervisor and report its system calls
+ * @param exe The FLE executable, used to symbolize call sites (may be empty)
+ * @param load Called in the child to map the image; returns the entry address
+ * @return Exit status of the program
+ *
+ * Prints an strace -c style table (calls, errors and time per syscall) and
+ * the hottest call sites to stderr. Call sites are recovered by scanning the
+ * stack for return addresses that follow a direct call into the current function.
+ */
+int FLE_syscall_stats(const FLEObject& exe, const std::function<uint64_t()>& load);
 
 /**
  * Link multiple FLE objects into an executable
  * @param objects Vector of FLE objects to link
+ * @param options Linker options (see LinkOptions)
  * @return A new FLE object of type ".exe"
  *
  * The linker should:
@@ -212,7 +550,32 @@ void FLE_exec(const FLEObject& obj);
  *    - Multiple weak symbols: use first one
  * 3. Process relocations
  */
-FLEObject FLE_ld(const std::vector<FLEObject>& objects);
+FLEObject FLE_ld(const std::vector<FLEObject>& objects, const LinkOptions& options = {});
+FLEObject FLE_ld(const std::vector<const FLEObject*>& objects, const LinkOptions& options = {}); // Same, without copying the inputs
+
+/**
+ * Link object files straight into an ELF executable with bounded memory
+ * @param inputs Paths of FLE files or ELF objects
+ * @param outfile Path of the ELF executable to write
+ * @param options Linker options (see LinkOptions)
+ *
+ * Layout and symbol resolution use only metadata of the inputs. Afterwards
+ * each input is loaded once more, its sections are relocated and written at
+ * their final file offsets, and it is released before the next one is loaded.
+ */
+void FLE_ld_stream(const std::vector<std::string>& inputs, const std::string& outfile, const LinkOptions& options = {});
+
+/**
+ * Dry-run a link: print the address map, section sizes, relocation count and
+ * the estimated peak memory of a real link, without writing any output
+ * @param inputs Paths of FLE files or ELF objects
+ * @param load Loader used for the inputs
+ * @param options Linker options (see LinkOptions)
+ *
+ * Runs loading, symbol resolution, layout and relocation range checks only.
+ * Section contents are never copied.
+ */
+void FLE_ld_plan(const std::vector<std::string>& inputs, const ObjectLoader& load, const LinkOptions& options = {});
 
 /**
  * Read FLE object file
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/un.h>
+
+// 常驻服务（ld --server 与 exec --fork-server）共用的 Unix 套接字工具
+
+// 带上 errno 描述的异常
+std::runtime_error system_error(const std::string& what);
+
+sockaddr_un socket_address(const std::string& path);
+
+// 写完全部数据，被信号打断时重试
+void write_all(int fd, std::string_view data);
+
+// 读到文件尾
+std::string read_all(int fd);
+
+// 在 socket_path 上监听，返回监听套接字；type_flags 并入 socket() 的类型（如 SOCK_CLOEXEC）。
+// 先绑定到临时路径，listen 之后再改名到位：客户端一看到套接字文件就能连上
+int listen_socket(const std::string& socket_path, int type_flags = 0);
+
+// 连接 socket_path 上的服务，server 用于报错
+int connect_socket(const std::string& socket_path, const std::string& server);
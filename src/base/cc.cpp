@@ -75,7 +75,10 @@ constexpr auto RELOCATION_FORMATS = std::array {
     std::pair { "R_X86_64_PLT32"sv, RelocationFormat { ".rel"sv, 4 } },
     std::pair { "R_X86_64_64"sv, RelocationFormat { ".abs64"sv, 8 } },
     std::pair { "R_X86_64_32"sv, RelocationFormat { ".abs"sv, 4 } },
-    std::pair { "R_X86_64_32S"sv, RelocationFormat { ".abs32s"sv, 4 } }
+    std::pair { "R_X86_64_32S"sv, RelocationFormat { ".abs32s"sv, 4 } },
+    std::pair { "R_X86_64_GOTPCREL"sv, RelocationFormat { ".gotpcrel"sv, 4 } },
+    std::pair { "R_X86_64_GOTPCRELX"sv, RelocationFormat { ".gotpcrelx"sv, 4 } },
+    std::pair { "R_X86_64_REX_GOTPCRELX"sv, RelocationFormat { ".rexgotpcrelx"sv, 4 } }
 };
 
 // 解析符号表
@@ -121,12 +124,13 @@ std::map<int, std::pair<int, std::string>> parse_relocations(
     };
 
     std::map<int, std::pair<int, std::string>> relocations;
-    const auto reloc_dump = execute_command(std::format("readelf -r {}", binary));
+    // -W 防止较长的类型名（如 R_X86_64_REX_GOTPCRELX）被截断
+    const auto reloc_dump = execute_command(std::format("readelf -rW {}", binary));
     bool in_section = false;
 
     for (const auto& line : splitlines(reloc_dump)) {
         if (str_contains(line, "Relocation section")) {
-            in_section = str_contains(line, std::format(".rela{}", section));
+            in_section = str_contains(line, std::format("'.rela{}'", section));
             continue;
         }
 
@@ -158,6 +162,29 @@ std::map<int, std::pair<int, std::string>> parse_relocations(
     return relocations;
 }
 
+// 解析 COMDAT 节组
+std::vector<SectionGroup> parse_groups(const std::string& binary)
+{
+    static const std::regex group_pattern {
+        R"(^COMDAT group section \[\s*\d+\]\s+`[^']*'\s+\[([^\]]+)\].*$)"
+    };
+    static const std::regex member_pattern {
+        R"(^\s*\[\s*\d+\]\s+(\S+)\s*$)"
+    };
+
+    std::vector<SectionGroup> groups;
+    const auto group_dump = execute_command(std::format("readelf -gW {}", binary));
+
+    for (const auto& line : splitlines(group_dump)) {
+        if (std::smatch match; std::regex_match(line, match, group_pattern)) {
+            groups.push_back(SectionGroup { match[1].str(), {} });
+        } else if (std::regex_match(line, match, member_pattern) && !groups.empty()) {
+            groups.back().sections.push_back(match[1].str());
+        }
+    }
+    return groups;
+}
+
 std::vector<std::string> elf_to_fle(
     const std::string& binary, std::string_view section, bool is_bss = false)
 {
@@ -325,6 +352,21 @@ void FLE_cc(const std::vector<std::string>& options)
     // 先写入所有节头
     writer.write_section_headers(section_headers);
 
+    // COMDAT 节组，只保留需要处理的节
+    std::vector<SectionGroup> groups;
+    for (auto& group : parse_groups(binary)) {
+        std::erase_if(group.sections, [&](const std::string& name) {
+            return !contains(sections_to_process, std::pair { name, false })
+                && !contains(sections_to_process, std::pair { name, true });
+        });
+        if (!group.sections.empty()) {
+            groups.push_back(std::move(group));
+        }
+    }
+    if (!groups.empty()) {
+        writer.write_groups(groups);
+    }
+
     // 第二遍:写入节数据
     for (const auto& [section_name, is_nobits] : sections_to_process) {
         writer.begin_section(section_name);
@@ -0,0 +1,316 @@
+#include "fle.hpp"
+#include "string_utils.hpp"
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// <elf.h> 把重定位类型定义成宏，与 RelocationType 的枚举名冲突，
+// 先保存数值再取消宏定义
+namespace elf_reloc {
+constexpr uint32_t PC32 = R_X86_64_PC32;
+constexpr uint32_t PLT32 = R_X86_64_PLT32;
+constexpr uint32_t ABS64 = R_X86_64_64;
+constexpr uint32_t ABS32 = R_X86_64_32;
+constexpr uint32_t ABS32S = R_X86_64_32S;
+constexpr uint32_t GOTPCREL = R_X86_64_GOTPCREL;
+constexpr uint32_t GOTPCRELX = R_X86_64_GOTPCRELX;
+constexpr uint32_t REX_GOTPCRELX = R_X86_64_REX_GOTPCRELX;
+}
+#undef R_X86_64_PC32
+#undef R_X86_64_64
+#undef R_X86_64_32
+#undef R_X86_64_32S
+#undef R_X86_64_GOTPCREL
+#undef R_X86_64_GOTPCRELX
+#undef R_X86_64_REX_GOTPCRELX
+
+namespace {
+
+template <typename T>
+T pod_at(const std::string& buffer, uint64_t offset, const std::string& file)
+{
+    if (offset + sizeof(T) > buffer.size()) {
+        throw std::runtime_error("Truncated ELF file: " + file);
+    }
+    T value;
+    std::memcpy(&value, buffer.data() + offset, sizeof(T));
+    return value;
+}
+
+std::string string_at(const std::string& strtab, uint32_t offset, const std::string& file)
+{
+    if (offset >= strtab.size()) {
+        throw std::runtime_error("Truncated ELF file: " + file);
+    }
+    return std::string(strtab.c_str() + offset);
+}
+
+// 与 FLE_cc 的 RELOCATION_FORMATS 保持一致
+RelocationType to_relocation_type(uint32_t type)
+{
+    switch (type) {
+    case elf_reloc::PC32:
+    case elf_reloc::PLT32:
+        return RelocationType::R_X86_64_PC32;
+    case elf_reloc::ABS64:
+        return RelocationType::R_X86_64_64;
+    case elf_reloc::ABS32:
+        return RelocationType::R_X86_64_32;
+    case elf_reloc::ABS32S:
+        return RelocationType::R_X86_64_32S;
+    case elf_reloc::GOTPCREL:
+        return RelocationType::R_X86_64_GOTPCREL;
+    case elf_reloc::GOTPCRELX:
+        return RelocationType::R_X86_64_GOTPCRELX;
+    case elf_reloc::REX_GOTPCRELX:
+        return RelocationType::R_X86_64_REX_GOTPCRELX;
+    default:
+        throw std::runtime_error("Unsupported relocation type: " + std::to_string(type));
+    }
+}
+
+} // anonymous namespace
+
+bool is_elf_file(const std::string& filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    char magic[SELFMAG] = {};
+    in.read(magic, SELFMAG);
+    return in && std::memcmp(magic, ELFMAG, SELFMAG) == 0;
+}
+
+ElfObjectReader::ElfObjectReader(const std::string& filename)
+    : filename(filename)
+    , in(filename, std::ios::binary)
+{
+    if (!in) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+    in.seekg(0, std::ios::end);
+    const uint64_t file_size = in.tellg();
+
+    const auto ehdr = pod_at<Elf64_Ehdr>(read_raw(0, std::min<uint64_t>(sizeof(Elf64_Ehdr), file_size)), 0, filename);
+    if (std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0
+        || ehdr.e_ident[EI_CLASS] != ELFCLASS64 || ehdr.e_machine != EM_X86_64) {
+        throw std::runtime_error("Not an x86-64 ELF64 file: " + filename);
+    }
+    if (ehdr.e_type != ET_REL) {
+        throw std::runtime_error("Not a relocatable ELF object: " + filename);
+    }
+
+    const std::string shdr_table = read_raw(ehdr.e_shoff, static_cast<uint64_t>(ehdr.e_shnum) * ehdr.e_shentsize);
+    std::vector<Elf64_Shdr> shdrs;
+    for (size_t i = 0; i < ehdr.e_shnum; ++i) {
+        shdrs.push_back(pod_at<Elf64_Shdr>(shdr_table, i * ehdr.e_shentsize, filename));
+    }
+    auto contents = [&](const Elf64_Shdr& shdr) { return read_raw(shdr.sh_offset, shdr.sh_size); };
+    const std::string shstrtab = contents(shdrs.at(ehdr.e_shstrndx));
+    auto section_name = [&](size_t index) {
+        return string_at(shstrtab, shdrs.at(index).sh_name, filename);
+    };
+
+    obj.name = get_basename(filename);
+    obj.type = ".obj";
+
+    // 1. 与 FLE_cc 相同的规则挑选节：需要分配内存，且不是 GNU 属性注记。
+    //    这里只记下节的位置，内容由 read 按需读取
+    std::vector<bool> kept(shdrs.size(), false);
+    for (size_t i = 0; i < shdrs.size(); ++i) {
+        const auto& shdr = shdrs[i];
+        const auto name = section_name(i);
+        if (!(shdr.sh_flags & SHF_ALLOC) || name.find("note.gnu.property") != std::string::npos) {
+            continue;
+        }
+        kept[i] = true;
+
+        const bool nobits = shdr.sh_type == SHT_NOBITS;
+        if (!nobits && shdr.sh_offset + shdr.sh_size > file_size) {
+            throw std::runtime_error("Truncated ELF file: " + filename);
+        }
+        extents[name] = Extent { shdr.sh_offset, nobits ? 0 : shdr.sh_size, {} };
+        obj.sections[name] = FLESection { {}, {}, nobits ? shdr.sh_size : 0 };
+    }
+
+    // 2. 符号表
+    const Elf64_Shdr* symtab_shdr = nullptr;
+    for (const auto& shdr : shdrs) {
+        if (shdr.sh_type == SHT_SYMTAB) {
+            symtab_shdr = &shdr;
+            break;
+        }
+    }
+    if (!symtab_shdr) {
+        return;
+    }
+    const std::string symtab = contents(*symtab_shdr);
+    const std::string strtab = contents(shdrs.at(symtab_shdr->sh_link));
+    const size_t symbol_count = symtab.size() / sizeof(Elf64_Sym);
+
+    auto symbol_at = [&](size_t index) {
+        return pod_at<Elf64_Sym>(symtab, index * sizeof(Elf64_Sym), filename);
+    };
+    // 节符号没有名字，用节名代替（与 objdump -t 的输出一致）
+    auto symbol_name = [&](const Elf64_Sym& sym) {
+        if (ELF64_ST_TYPE(sym.st_info) == STT_SECTION) {
+            return section_name(sym.st_shndx);
+        }
+        return string_at(strtab, sym.st_name, filename);
+    };
+
+    for (size_t i = 1; i < symbol_count; ++i) {
+        const auto sym = symbol_at(i);
+        // 暂定定义（gcc -fcommon）：在本目标文件的 .bss 末尾按 st_value 对齐分配，
+        // 作为弱符号，别处的强定义优先，多个暂定定义取第一个
+        if (sym.st_shndx == SHN_COMMON) {
+            auto& bss = obj.sections.try_emplace(".bss", FLESection { {}, {}, 0 }).first->second;
+            extents.try_emplace(".bss", Extent { 0, 0, {} });
+            const uint64_t align = std::max<uint64_t>(sym.st_value, 1);
+            const uint64_t offset = (bss.bss_size + align - 1) / align * align;
+            bss.bss_size = offset + sym.st_size;
+            obj.symbols.push_back(Symbol { SymbolType::WEAK, ".bss", offset, sym.st_size, symbol_name(sym) });
+            continue;
+        }
+        if (sym.st_shndx == SHN_UNDEF || sym.st_shndx >= SHN_LORESERVE || !kept[sym.st_shndx]) {
+            continue;
+        }
+
+        SymbolType type;
+        switch (ELF64_ST_BIND(sym.st_info)) {
+        case STB_LOCAL:
+            type = SymbolType::LOCAL;
+            break;
+        case STB_GLOBAL:
+            type = SymbolType::GLOBAL;
+            break;
+        case STB_WEAK:
+            type = SymbolType::WEAK;
+            break;
+        default:
+            continue;
+        }
+
+        obj.symbols.push_back(Symbol {
+            type,
+            section_name(sym.st_shndx),
+            sym.st_value,
+            sym.st_size,
+            symbol_name(sym) });
+    }
+
+    // 3. COMDAT 节组：签名是 sh_info 指向的符号名，内容是 GRP_COMDAT 标志加成员节下标
+    for (const auto& shdr : shdrs) {
+        if (shdr.sh_type != SHT_GROUP || shdr.sh_size < sizeof(Elf32_Word)) {
+            continue;
+        }
+        const std::string members = contents(shdr);
+        if (!(pod_at<Elf32_Word>(members, 0, filename) & GRP_COMDAT)) {
+            continue;
+        }
+
+        SectionGroup group;
+        group.signature = symbol_name(symbol_at(shdr.sh_info));
+        for (uint64_t off = sizeof(Elf32_Word); off + sizeof(Elf32_Word) <= members.size(); off += sizeof(Elf32_Word)) {
+            const auto member = pod_at<Elf32_Word>(members, off, filename);
+            if (member < shdrs.size() && kept[member]) {
+                group.sections.push_back(section_name(member));
+            }
+        }
+        if (!group.sections.empty()) {
+            obj.groups.push_back(std::move(group));
+        }
+    }
+
+    // 4. 重定位：.rela<节名>
+    for (const auto& shdr : shdrs) {
+        if (shdr.sh_type != SHT_RELA || !kept[shdr.sh_info]) {
+            continue;
+        }
+        const auto name = section_name(shdr.sh_info);
+        auto& section = obj.sections[name];
+        auto& extent = extents[name];
+        const std::string relas = contents(shdr);
+
+        for (size_t off = 0; off + sizeof(Elf64_Rela) <= relas.size(); off += sizeof(Elf64_Rela)) {
+            const auto rela = pod_at<Elf64_Rela>(relas, off, filename);
+            const auto type = to_relocation_type(ELF64_R_TYPE(rela.r_info));
+            const auto sym = symbol_at(ELF64_R_SYM(rela.r_info));
+
+            // FLE 中 PC 相对类（.rel 与 GOT 类）的加数与 FLE_ld 的公式
+            // （S + A - P - 8）配套，绝对类型直接使用 ELF 加数
+            int64_t addend = rela.r_addend;
+            if (is_pc_relative(type)) {
+                addend += 8;
+            }
+
+            section.relocs.push_back(Relocation {
+                type,
+                rela.r_offset,
+                symbol_name(sym),
+                addend });
+
+            const uint8_t size = (type == RelocationType::R_X86_64_64) ? 8 : 4;
+            if (rela.r_offset + size > extent.size) {
+                throw std::runtime_error("Relocation out of section bounds in " + filename);
+            }
+            extent.fields.emplace_back(rela.r_offset, size);
+        }
+    }
+    for (auto& [name, extent] : extents) {
+        std::sort(extent.fields.begin(), extent.fields.end());
+    }
+}
+
+uint64_t ElfObjectReader::section_size(const std::string& name) const
+{
+    const auto& extent = extents.at(name);
+    return extent.size ? extent.size : obj.sections.at(name).bss_size;
+}
+
+std::vector<uint8_t> ElfObjectReader::read(const std::string& name, uint64_t offset, uint64_t size)
+{
+    const auto& extent = extents.at(name);
+    if (offset + size > extent.size) {
+        throw std::runtime_error("Read past the end of section " + name + " in " + filename);
+    }
+    const std::string raw = read_raw(extent.offset + offset, size);
+    std::vector<uint8_t> data(raw.begin(), raw.end());
+
+    // 重定位字段清零，最长 8 字节，从可能与 offset 重叠的第一个字段开始
+    auto it = std::lower_bound(extent.fields.begin(), extent.fields.end(),
+        std::pair<uint64_t, uint8_t>(offset < 8 ? 0 : offset - 8, 0));
+    for (; it != extent.fields.end() && it->first < offset + size; ++it) {
+        const uint64_t begin = std::max(it->first, offset);
+        const uint64_t end = std::min(it->first + it->second, offset + size);
+        if (begin < end) {
+            std::fill(data.begin() + (begin - offset), data.begin() + (end - offset), 0);
+        }
+    }
+    return data;
+}
+
+std::string ElfObjectReader::read_raw(uint64_t offset, uint64_t size)
+{
+    std::string buffer(size, '\0');
+    in.clear();
+    in.seekg(offset);
+    if (!in.read(buffer.data(), size)) {
+        throw std::runtime_error("Truncated ELF file: " + filename);
+    }
+    return buffer;
+}
+
+FLEObject load_elf(const std::string& filename)
+{
+    ElfObjectReader reader(filename);
+    FLEObject obj = reader.object();
+    for (auto& [name, section] : obj.sections) {
+        if (!section.bss_size) {
+            section.data = reader.read(name, 0, reader.section_size(name));
+        }
+    }
+    return obj;
+}
@@ -0,0 +1,273 @@
+#include "fle.hpp"
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t ELF_PAGE_SIZE = 0x1000;
+
+uint64_t align_up(uint64_t value, uint64_t align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+uint32_t to_elf_pflags(uint32_t flags)
+{
+    return (flags & static_cast<uint32_t>(PHF::R) ? PF_R : 0)
+        | (flags & static_cast<uint32_t>(PHF::W) ? PF_W : 0)
+        | (flags & static_cast<uint32_t>(PHF::X) ? PF_X : 0);
+}
+
+uint64_t to_elf_shflags(uint32_t flags)
+{
+    return SHF_ALLOC
+        | (flags & static_cast<uint32_t>(PHF::W) ? SHF_WRITE : 0)
+        | (flags & static_cast<uint32_t>(PHF::X) ? SHF_EXECINSTR : 0);
+}
+
+// NT_GNU_BUILD_ID 注记：名字 "GNU"，描述为 build-id 的原始字节
+std::string build_id_note(const std::string& build_id)
+{
+    if (build_id.empty()) {
+        return {};
+    }
+    if (build_id.size() % 2 != 0) {
+        throw std::runtime_error("Malformed build ID: " + build_id);
+    }
+    std::string desc;
+    for (size_t i = 0; i < build_id.size(); i += 2) {
+        desc += static_cast<char>(std::stoi(build_id.substr(i, 2), nullptr, 16));
+    }
+    desc.resize(align_up(desc.size(), 4), '\0');
+
+    Elf64_Nhdr nhdr {};
+    nhdr.n_namesz = sizeof(ELF_NOTE_GNU);
+    nhdr.n_descsz = build_id.size() / 2;
+    nhdr.n_type = NT_GNU_BUILD_ID;
+    std::string note(reinterpret_cast<const char*>(&nhdr), sizeof(nhdr));
+    note.append(ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU));
+    return note + desc;
+}
+
+} // anonymous namespace
+
+std::vector<ElfSegment> write_elf_headers(const FLEObject& obj, std::ostream& out)
+{
+    if (obj.type != ".exe") {
+        throw std::runtime_error("ELF output requires an executable FLE object");
+    }
+
+    // 每个程序头对应一个 PT_LOAD 段，文件偏移与虚拟地址模页大小同余
+    std::vector<ElfSegment> segments;
+    uint64_t file_offset = sizeof(Elf64_Ehdr) + obj.phdrs.size() * sizeof(Elf64_Phdr);
+    for (const auto& phdr : obj.phdrs) {
+        // BSS 没有数据，只占内存不占文件
+        uint64_t filesz = is_bss_section(phdr.name) ? 0 : phdr.size;
+        const uint64_t align = std::max(phdr.align, ELF_PAGE_SIZE);
+        file_offset = align_up(file_offset, align) + phdr.vaddr % align;
+        segments.push_back({ file_offset, filesz });
+        file_offset += filesz;
+    }
+
+    // 符号表：局部符号必须排在全局符号之前，sh_info 为第一个非局部符号的下标
+    std::vector<Elf64_Sym> symtab(1);
+    std::string strtab(1, '\0');
+    uint32_t first_global = 1;
+    for (bool locals : { true, false }) {
+        for (const auto& sym : obj.symbols) {
+            if ((sym.type == SymbolType::LOCAL) != locals)
+                continue;
+            auto phdr = std::find_if(obj.phdrs.begin(), obj.phdrs.end(),
+                [&](const ProgramHeader& phdr) { return phdr.name == sym.section; });
+            const bool code = phdr != obj.phdrs.end() && (phdr->flags & static_cast<uint32_t>(PHF::X));
+            const unsigned char bind = sym.type == SymbolType::LOCAL ? STB_LOCAL : sym.type == SymbolType::WEAK ? STB_WEAK
+                                                                                                                 : STB_GLOBAL;
+            Elf64_Sym elf_sym {};
+            elf_sym.st_name = strtab.size();
+            elf_sym.st_info = ELF64_ST_INFO(bind, code ? STT_FUNC : STT_OBJECT);
+            elf_sym.st_shndx = phdr != obj.phdrs.end() ? static_cast<uint16_t>(phdr - obj.phdrs.begin() + 1) : SHN_ABS;
+            elf_sym.st_value = sym.offset;
+            elf_sym.st_size = sym.size;
+            symtab.push_back(elf_sym);
+            strtab += sym.name;
+            strtab += '\0';
+        }
+        if (locals) {
+            first_global = symtab.size();
+        }
+    }
+    const bool has_symtab = symtab.size() > 1;
+    const std::string note = build_id_note(obj.build_id);
+    const bool has_note = !note.empty();
+
+    // 节名字符串表
+    std::string shstrtab(1, '\0');
+    std::vector<uint32_t> name_offsets;
+    for (const auto& phdr : obj.phdrs) {
+        name_offsets.push_back(shstrtab.size());
+        shstrtab += phdr.name;
+        shstrtab += '\0';
+    }
+    const uint32_t note_name = shstrtab.size();
+    shstrtab += ".note.gnu.build-id";
+    shstrtab += '\0';
+    const uint32_t symtab_name = shstrtab.size();
+    shstrtab += ".symtab";
+    shstrtab += '\0';
+    const uint32_t strtab_name = shstrtab.size();
+    shstrtab += ".strtab";
+    shstrtab += '\0';
+    const uint32_t shstrtab_name = shstrtab.size();
+    shstrtab += ".shstrtab";
+    shstrtab += '\0';
+
+    // 段之后依次是 [.note.gnu.build-id]、[.symtab、.strtab]、.shstrtab 与节头表
+    const uint64_t note_offset = align_up(file_offset, 8);
+    const uint64_t symtab_offset = align_up(note_offset + note.size(), 8);
+    const uint64_t strtab_offset = symtab_offset + (has_symtab ? symtab.size() * sizeof(Elf64_Sym) : 0);
+    const uint64_t shstrtab_offset = strtab_offset + (has_symtab ? strtab.size() : 0);
+    const uint64_t shdr_offset = align_up(shstrtab_offset + shstrtab.size(), 8);
+    // 空节 + 各段 + [.note.gnu.build-id] + [.symtab + .strtab] + .shstrtab
+    const uint16_t shnum = obj.phdrs.size() + (has_note ? 1 : 0) + (has_symtab ? 4 : 2);
+
+    Elf64_Ehdr ehdr {};
+    std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_EXEC;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_entry = obj.entry;
+    ehdr.e_phoff = sizeof(Elf64_Ehdr);
+    ehdr.e_shoff = shdr_offset;
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf64_Phdr);
+    ehdr.e_phnum = obj.phdrs.size();
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = shnum;
+    ehdr.e_shstrndx = shnum - 1;
+
+    std::vector<Elf64_Phdr> phdrs(obj.phdrs.size());
+    for (size_t i = 0; i < segments.size(); ++i) {
+        auto& phdr = phdrs[i];
+        phdr.p_type = PT_LOAD;
+        phdr.p_flags = to_elf_pflags(obj.phdrs[i].flags);
+        phdr.p_offset = segments[i].offset;
+        phdr.p_vaddr = obj.phdrs[i].vaddr;
+        phdr.p_paddr = obj.phdrs[i].vaddr;
+        phdr.p_filesz = segments[i].filesz;
+        phdr.p_memsz = obj.phdrs[i].size;
+        phdr.p_align = std::max(obj.phdrs[i].align, ELF_PAGE_SIZE);
+    }
+
+    // 节头：让 readelf/objdump/perf 等工具能看到每个输出节
+    std::vector<Elf64_Shdr> shdrs(shnum);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        auto& shdr = shdrs[i + 1];
+        shdr.sh_name = name_offsets[i];
+        shdr.sh_type = segments[i].filesz ? SHT_PROGBITS : SHT_NOBITS;
+        shdr.sh_flags = to_elf_shflags(obj.phdrs[i].flags);
+        shdr.sh_addr = obj.phdrs[i].vaddr;
+        shdr.sh_offset = segments[i].offset;
+        shdr.sh_size = obj.phdrs[i].size;
+        shdr.sh_addralign = 16;
+    }
+    if (has_note) {
+        auto& note_shdr = shdrs[segments.size() + 1];
+        note_shdr.sh_name = note_name;
+        note_shdr.sh_type = SHT_NOTE;
+        note_shdr.sh_offset = note_offset;
+        note_shdr.sh_size = note.size();
+        note_shdr.sh_addralign = 4;
+    }
+    if (has_symtab) {
+        const size_t symtab_index = segments.size() + (has_note ? 2 : 1);
+        auto& symtab_shdr = shdrs[symtab_index];
+        symtab_shdr.sh_name = symtab_name;
+        symtab_shdr.sh_type = SHT_SYMTAB;
+        symtab_shdr.sh_offset = symtab_offset;
+        symtab_shdr.sh_size = symtab.size() * sizeof(Elf64_Sym);
+        symtab_shdr.sh_link = symtab_index + 1;
+        symtab_shdr.sh_info = first_global;
+        symtab_shdr.sh_addralign = 8;
+        symtab_shdr.sh_entsize = sizeof(Elf64_Sym);
+
+        auto& strtab_shdr = shdrs[symtab_index + 1];
+        strtab_shdr.sh_name = strtab_name;
+        strtab_shdr.sh_type = SHT_STRTAB;
+        strtab_shdr.sh_offset = strtab_offset;
+        strtab_shdr.sh_size = strtab.size();
+        strtab_shdr.sh_addralign = 1;
+    }
+    auto& shstrtab_shdr = shdrs.back();
+    shstrtab_shdr.sh_name = shstrtab_name;
+    shstrtab_shdr.sh_type = SHT_STRTAB;
+    shstrtab_shdr.sh_offset = shstrtab_offset;
+    shstrtab_shdr.sh_size = shstrtab.size();
+    shstrtab_shdr.sh_addralign = 1;
+
+    // 段内容之间的空洞由文件系统补零
+    const std::string padding(8, '\0');
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&ehdr), sizeof(ehdr));
+    out.write(reinterpret_cast<const char*>(phdrs.data()), phdrs.size() * sizeof(Elf64_Phdr));
+    out.seekp(file_offset);
+    out.write(padding.data(), note_offset - file_offset);
+    out.write(note.data(), note.size());
+    out.write(padding.data(), symtab_offset - note_offset - note.size());
+    if (has_symtab) {
+        out.write(reinterpret_cast<const char*>(symtab.data()), symtab.size() * sizeof(Elf64_Sym));
+        out.write(strtab.data(), strtab.size());
+    }
+    out.write(shstrtab.data(), shstrtab.size());
+    out.write(padding.data(), shdr_offset - shstrtab_offset - shstrtab.size());
+    out.write(reinterpret_cast<const char*>(shdrs.data()), shnum * sizeof(Elf64_Shdr));
+    if (!out) {
+        throw std::runtime_error("Failed to write ELF headers");
+    }
+    return segments;
+}
+
+void mark_executable(const std::string& filename)
+{
+    using std::filesystem::perms;
+    std::filesystem::permissions(filename,
+        perms::owner_exec | perms::group_exec | perms::others_exec,
+        std::filesystem::perm_options::add);
+}
+
+void FLE_write_elf(const FLEObject& obj, const std::string& filename)
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot open output file: " + filename);
+    }
+
+    const auto segments = write_elf_headers(obj, out);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (!segments[i].filesz) {
+            continue;
+        }
+        const auto& phdr = obj.phdrs[i];
+        auto it = obj.sections.find(phdr.name);
+        if (it == obj.sections.end() || it->second.data.size() < segments[i].filesz) {
+            throw std::runtime_error("Section not found: " + phdr.name);
+        }
+        out.seekp(segments[i].offset);
+        out.write(reinterpret_cast<const char*>(it->second.data.data()), segments[i].filesz);
+    }
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Failed to write output file: " + filename);
+    }
+
+    mark_executable(filename);
+}
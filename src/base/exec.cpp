@@ -1,51 +1,832 @@
 #include "fle.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <fstream>
+#include <optional>
 #include <stdexcept>
+#include <string>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
 
-void FLE_exec(const FLEObject& obj)
+namespace {
+
+constexpr uint64_t PAGE_SIZE = 0x1000;
+constexpr uint64_t HUGE_PAGE_SIZE = 0x200000;
+
+uint64_t page_down(uint64_t addr)
+{
+    return addr & ~(PAGE_SIZE - 1);
+}
+
+uint64_t page_up(uint64_t addr)
+{
+    return (addr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+std::runtime_error system_error(const std::string& what)
+{
+    return std::runtime_error(what + " failed: " + strerror(errno));
+}
+
+// /proc/self/smaps 中包含 addr 的映射所含透明大页的大小（kB）。
+// 相邻且属性相同的映射会被内核合并，所以这里按区间查找而不是按起始地址
+size_t anon_huge_kb(const void* addr)
+{
+    const auto target = reinterpret_cast<unsigned long>(addr);
+    std::ifstream smaps("/proc/self/smaps");
+    bool in_mapping = false;
+    for (std::string line; std::getline(smaps, line);) {
+        unsigned long start, end;
+        if (std::sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2) {
+            in_mapping = start <= target && target < end;
+        } else if (in_mapping && line.starts_with("AnonHugePages:")) {
+            return std::stoul(line.substr(14));
+        }
+    }
+    return 0;
+}
+
+// 加载器发出的系统调用次数
+struct LoaderStats {
+    size_t mmap = 0;
+    size_t mprotect = 0;
+    size_t madvise = 0;
+    size_t file = 0; // open/pread/close
+
+    size_t total() const { return mmap + mprotect + madvise + file; }
+};
+
+// 带动态重定位表（ld --pie）的映像可以整体平移
+struct Relocatable {
+    uint64_t align; // 最大的段对齐，平移量必须是它的倍数
+    bool below_2g; // 有 32 位绝对地址时整个映像要落在低 2 GiB
+    bool anywhere; // 不先尝试链接时的地址（exec --relocate）
+};
+
+// 预留 [start, end)，返回实际的起始地址。链接时的区间被占用时，
+// 可平移的映像改由内核挑一段空闲区间，多预留一个对齐单位再裁掉两头
+uint64_t reserve_image(uint64_t start, uint64_t end, LoaderStats& stats, const std::optional<Relocatable>& relocatable)
+{
+    const uint64_t length = end - start;
+    if (!relocatable || !relocatable->anywhere) {
+        ++stats.mmap;
+        void* addr = mmap(reinterpret_cast<void*>(start), length, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (addr == reinterpret_cast<void*>(start)) {
+            return start;
+        }
+        const int error = errno;
+        // 不认识 MAP_FIXED_NOREPLACE 的旧内核会把它当作提示地址，映射到别处
+        if (addr != MAP_FAILED) {
+            munmap(addr, length);
+        }
+        if (!relocatable) {
+            char range[64];
+            std::snprintf(range, sizeof(range), "0x%lx-0x%lx", static_cast<unsigned long>(start),
+                static_cast<unsigned long>(end));
+            throw std::runtime_error(std::string("Image address range ") + range + " is not free: "
+                + (addr == MAP_FAILED ? strerror(error) : "kernel ignored MAP_FIXED_NOREPLACE"));
+        }
+    }
+
+    const uint64_t align = std::max(relocatable->align, PAGE_SIZE);
+    const uint64_t padded = length + align - PAGE_SIZE;
+    ++stats.mmap;
+    void* area = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | (relocatable->below_2g ? MAP_32BIT : 0), -1, 0);
+    if (area == MAP_FAILED) {
+        throw system_error("mmap");
+    }
+    // 与链接地址模 align 同余，大页段平移后仍然 2 MiB 对齐
+    const auto raw = reinterpret_cast<uint64_t>(area);
+    const uint64_t base = raw + ((start - raw) & (align - 1));
+    if (base > raw) {
+        munmap(area, base - raw);
+    }
+    if (raw + padded > base + length) {
+        munmap(reinterpret_cast<void*>(base + length), raw + padded - base - length);
+    }
+    return base;
+}
+
+// 映像的地址空间：先用一次 mmap 预留整个区间（可读写、全零），
+// 段内容填好后，把逐页的目标权限合并成尽量少的 mprotect 调用。
+// 之后的 MAP_FIXED 都落在自己预留的区间内，不会覆盖进程中已有的映射。
+// 地址一律使用链接时的地址，映像平移后由 at() 加上 bias
+class ImageAddressSpace {
+public:
+    ImageAddressSpace(uint64_t start, uint64_t end, LoaderStats& stats,
+        const std::optional<Relocatable>& relocatable = std::nullopt)
+        : start(start)
+        , end(end)
+        , bias(reserve_image(start, end, stats, relocatable) - start)
+        , current((end - start) / PAGE_SIZE, PROT_READ | PROT_WRITE)
+        , wanted((end - start) / PAGE_SIZE, PROT_NONE)
+        , stats(stats)
+    {
+    }
+
+    // 没走到 commit 就出错时归还预留的区间
+    ~ImageAddressSpace()
+    {
+        if (!committed) {
+            munmap(at(start), end - start);
+        }
+    }
+
+    void* at(uint64_t addr) const { return reinterpret_cast<void*>(addr + bias); }
+
+    // 在预留区间内重新映射 [addr, addr + length)，映射后的权限为 prot
+    void* remap(uint64_t addr, uint64_t length, int prot, int flags, int fd, uint64_t offset)
+    {
+        ++stats.mmap;
+        void* result = mmap(at(addr), length, prot, MAP_PRIVATE | MAP_FIXED | flags, fd, offset);
+        if (result != MAP_FAILED) {
+            std::fill_n(current.begin() + (addr - start) / PAGE_SIZE, length / PAGE_SIZE, prot);
+        }
+        return result;
+    }
+
+    void advise_hugepage(uint64_t addr, uint64_t length)
+    {
+        ++stats.madvise;
+        madvise(at(addr), length, MADV_HUGEPAGE);
+    }
+
+    // 记录 [addr, addr + length) 所在各页的最终权限；与其他段共用的页取权限的并集
+    void protect(uint64_t addr, uint64_t length, int prot)
+    {
+        for (uint64_t page = page_down(addr); page < page_up(addr + length); page += PAGE_SIZE) {
+            wanted[(page - start) / PAGE_SIZE] |= prot;
+        }
+    }
+
+    // 目标权限相同的连续页合成一段，段内有任何一页需要改动就整段 mprotect 一次
+    void commit()
+    {
+        for (size_t first = 0; first != wanted.size();) {
+            size_t last = first;
+            bool dirty = false;
+            for (; last != wanted.size() && wanted[last] == wanted[first]; ++last) {
+                dirty |= current[last] != wanted[last];
+            }
+            if (dirty) {
+                ++stats.mprotect;
+                if (mprotect(at(start + first * PAGE_SIZE), (last - first) * PAGE_SIZE, wanted[first]) < 0) {
+                    throw system_error("mprotect");
+                }
+                std::fill(current.begin() + first, current.begin() + last, wanted[first]);
+            }
+            first = last;
+        }
+        committed = true;
+    }
+
+    const uint64_t start;
+    const uint64_t end;
+    const uint64_t bias; // 实际地址与链接时地址之差（模 2^64）
+
+private:
+    std::vector<int> current; // 每页当前的权限
+    std::vector<int> wanted; // 每页最终的权限，空洞为 PROT_NONE
+    LoaderStats& stats;
+    bool committed = false;
+};
+
+int to_prot(uint32_t phf)
+{
+    return (phf & static_cast<uint32_t>(PHF::R) ? PROT_READ : 0)
+        | (phf & static_cast<uint32_t>(PHF::W) ? PROT_WRITE : 0)
+        | (phf & static_cast<uint32_t>(PHF::X) ? PROT_EXEC : 0);
+}
+
+int elf_to_prot(uint32_t elf_flags)
+{
+    return (elf_flags & PF_R ? PROT_READ : 0) | (elf_flags & PF_W ? PROT_WRITE : 0) | (elf_flags & PF_X ? PROT_EXEC : 0);
+}
+
+// 段之间不能重叠
+struct Extent {
+    uint64_t start;
+    uint64_t end;
+};
+
+void check_overlaps(std::vector<Extent> extents)
+{
+    std::sort(extents.begin(), extents.end(), [](const Extent& a, const Extent& b) { return a.start < b.start; });
+    for (size_t i = 1; i < extents.size(); ++i) {
+        if (extents[i].start < extents[i - 1].end) {
+            char message[96];
+            std::snprintf(message, sizeof(message), "Overlapping segments at 0x%lx and 0x%lx",
+                static_cast<unsigned long>(extents[i - 1].start), static_cast<unsigned long>(extents[i].start));
+            throw std::runtime_error(message);
+        }
+    }
+}
+
+void report(const ExecOptions& options, const ImageAddressSpace& space, size_t segments, const LoaderStats& stats)
+{
+    if (!options.loader_stats) {
+        return;
+    }
+    std::fprintf(stderr, "Loader: image 0x%lx-0x%lx, %zu segments, %zu syscalls (mmap %zu, mprotect %zu, madvise %zu, file %zu)\n",
+        static_cast<unsigned long>(space.start + space.bias), static_cast<unsigned long>(space.end + space.bias), segments,
+        stats.total(), stats.mmap, stats.mprotect, stats.madvise, stats.file);
+    if (space.bias != 0) {
+        std::fprintf(stderr, "Loader: relocated from 0x%lx\n", static_cast<unsigned long>(space.start));
+    }
+}
+
+void read_at(int fd, void* buffer, size_t size, uint64_t offset, const std::string& filename, LoaderStats& stats)
+{
+    ++stats.file;
+    if (pread(fd, buffer, size, offset) != static_cast<ssize_t>(size)) {
+        throw std::runtime_error("Truncated ELF executable: " + filename);
+    }
+}
+
+void run_entry(uint64_t entry)
+{
+    using FuncType = int (*)();
+    FuncType func = reinterpret_cast<FuncType>(entry);
+    func();
+
+    // Should not reach here, since `func` is NoReturn.
+    assert(false);
+}
+
+// 把 ELF 可执行文件映射进来，返回入口地址
+uint64_t map_elf(const std::string& filename, const ExecOptions& options)
+{
+    LoaderStats stats;
+    ++stats.file;
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+
+    Elf64_Ehdr ehdr;
+    read_at(fd, &ehdr, sizeof(ehdr), 0, filename, stats);
+    if (std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 || ehdr.e_ident[EI_CLASS] != ELFCLASS64
+        || ehdr.e_machine != EM_X86_64 || ehdr.e_type != ET_EXEC || ehdr.e_phentsize != sizeof(Elf64_Phdr)) {
+        throw std::runtime_error("Not a static x86-64 ELF executable: " + filename);
+    }
+    std::vector<Elf64_Phdr> all_phdrs(ehdr.e_phnum);
+    read_at(fd, all_phdrs.data(), all_phdrs.size() * sizeof(Elf64_Phdr), ehdr.e_phoff, filename, stats);
+
+    std::vector<Elf64_Phdr> phdrs;
+    std::vector<Extent> pages;
+    for (const auto& phdr : all_phdrs) {
+        if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0) {
+            continue;
+        }
+        if (phdr.p_offset % PAGE_SIZE != phdr.p_vaddr % PAGE_SIZE) {
+            throw std::runtime_error("Segment is not page-aligned in the file: " + filename);
+        }
+        phdrs.push_back(phdr);
+        // 文件映射以页为单位，段与段不能共用页
+        pages.push_back({ page_down(phdr.p_vaddr), page_up(phdr.p_vaddr + phdr.p_memsz) });
+    }
+    if (phdrs.empty()) {
+        throw std::runtime_error("No loadable segments: " + filename);
+    }
+    check_overlaps(pages);
+
+    uint64_t image_start = UINT64_MAX, image_end = 0;
+    for (const auto& extent : pages) {
+        image_start = std::min(image_start, extent.start);
+        image_end = std::max(image_end, extent.end);
+    }
+    ImageAddressSpace space(image_start, image_end, stats);
+
+    // 段在文件中与虚拟地址模页大小同余（ld --format=elf 保证这一点），
+    // 可以直接把文件页私有映射进来：只读段与其他进程共享页缓存，可写段写时复制。
+    // 超出文件内容的部分（BSS）沿用预留区间里的零页
+    for (const auto& phdr : phdrs) {
+        const uint64_t start = page_down(phdr.p_vaddr);
+        const uint64_t file_end = phdr.p_vaddr + phdr.p_filesz;
+        const uint64_t mem_end = phdr.p_vaddr + phdr.p_memsz;
+        const uint64_t file_map_end = phdr.p_filesz ? page_up(file_end) : start;
+        const int prot = elf_to_prot(phdr.p_flags);
+
+        if (file_map_end > start) {
+            // 需要清零 BSS 尾部时先以可写方式映射，最终权限统一在 commit 中设置
+            const bool zero_tail = mem_end > file_end && file_map_end > file_end;
+            void* addr = space.remap(start, file_map_end - start, zero_tail ? prot | PROT_WRITE : prot, 0, fd,
+                phdr.p_offset - (phdr.p_vaddr - start));
+            if (addr == MAP_FAILED) {
+                throw system_error("mmap");
+            }
+            if (phdr.p_align >= HUGE_PAGE_SIZE) {
+                space.advise_hugepage(start, file_map_end - start);
+            }
+            if (zero_tail) {
+                std::memset(space.at(file_end), 0, file_map_end - file_end);
+            }
+        }
+        space.protect(phdr.p_vaddr, phdr.p_memsz, prot);
+    }
+    // 映射建立后文件描述符就不再需要了
+    ++stats.file;
+    close(fd);
+
+    space.commit();
+    report(options, space, phdrs.size(), stats);
+    return ehdr.e_entry;
+}
+
+// 给动态重定位表中的每处绝对地址加上平移量；32 位的地址平移后必须仍然放得下
+void apply_dynamic_relocs(const DynamicRelocs& relocs, const ImageAddressSpace& space)
+{
+    auto site = [&](uint64_t addr, uint64_t width) {
+        if (addr < space.start || addr + width > space.end) {
+            char message[64];
+            std::snprintf(message, sizeof(message), "Dynamic relocation outside the image: 0x%lx",
+                static_cast<unsigned long>(addr));
+            throw std::runtime_error(message);
+        }
+        return space.at(addr);
+    };
+    auto overflow = [](uint64_t addr) {
+        char message[80];
+        std::snprintf(message, sizeof(message), "Relocated address does not fit in 32 bits at 0x%lx",
+            static_cast<unsigned long>(addr));
+        return std::runtime_error(message);
+    };
+
+    const auto delta = static_cast<int64_t>(space.bias);
+    for (uint64_t addr : relocs.abs64) {
+        void* p = site(addr, 8);
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        value += space.bias;
+        std::memcpy(p, &value, sizeof(value));
+    }
+    for (uint64_t addr : relocs.abs32) {
+        void* p = site(addr, 4);
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        const int64_t moved = static_cast<int64_t>(value) + delta;
+        if (moved < 0 || moved > static_cast<int64_t>(UINT32_MAX)) {
+            throw overflow(addr);
+        }
+        value = static_cast<uint32_t>(moved);
+        std::memcpy(p, &value, sizeof(value));
+    }
+    for (uint64_t addr : relocs.abs32s) {
+        void* p = site(addr, 4);
+        int32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        const int64_t moved = static_cast<int64_t>(value) + delta;
+        if (moved < INT32_MIN || moved > INT32_MAX) {
+            throw overflow(addr);
+        }
+        value = static_cast<int32_t>(moved);
+        std::memcpy(p, &value, sizeof(value));
+    }
+}
+
+// 按 2 MiB 对齐的段（ld --hugepage-text）整段占用大页大小的倍数
+uint64_t mapped_length(const ProgramHeader& phdr)
+{
+    const bool huge = phdr.align >= HUGE_PAGE_SIZE;
+    return huge ? (phdr.size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1) : page_up(phdr.size);
+}
+
+// exec --batch：把程序的 syscall() 改成跳到宿主的处理函数
+//   48 b8 imm64   movabs $hook, %rax
+//   ff e0         jmp *%rax
+void patch_syscall(const FLEObject& obj, const ImageAddressSpace& space, uint64_t hook)
+{
+    auto sym = std::find_if(obj.symbols.begin(), obj.symbols.end(),
+        [](const Symbol& sym) { return sym.name == "syscall" && sym.type != SymbolType::LOCAL; });
+    uint8_t stub[12] = { 0x48, 0xb8 };
+    if (sym == obj.symbols.end() || (sym->size != 0 && sym->size < sizeof(stub))) {
+        throw std::runtime_error("No syscall() to intercept in " + obj.name);
+    }
+    std::memcpy(stub + 2, &hook, sizeof(hook));
+    stub[10] = 0xff;
+    stub[11] = 0xe0;
+    std::memcpy(space.at(sym->offset), stub, sizeof(stub));
+}
+
+// 把 FLE 可执行文件的各段复制进来，返回映像实际所在的区间与入口
+LoadedImage map_fle(const FLEObject& obj, const ExecOptions& options, uint64_t syscall_hook = 0)
 {
     if (obj.type != ".exe") {
         throw std::runtime_error("File is not an executable FLE.");
     }
+    if (obj.phdrs.empty()) {
+        throw std::runtime_error("No program headers in executable FLE.");
+    }
 
-    // Map each section
+    std::vector<Extent> extents;
+    uint64_t image_start = UINT64_MAX, image_end = 0;
     for (const auto& phdr : obj.phdrs) {
-        void* addr = mmap((void*)phdr.vaddr, phdr.size,
-            PROT_READ | PROT_WRITE,
-            MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
-        // ! We need to set the permissions after copying the data
+        extents.push_back({ phdr.vaddr, phdr.vaddr + phdr.size });
+        image_start = std::min(image_start, page_down(phdr.vaddr));
+        image_end = std::max(image_end, page_down(phdr.vaddr) + mapped_length(phdr));
+    }
+    check_overlaps(extents);
 
-        if (addr == MAP_FAILED) {
-            throw std::runtime_error(std::string("mmap failed: ") + strerror(errno));
+    std::optional<Relocatable> relocatable;
+    if (obj.dynamic_relocs) {
+        uint64_t align = PAGE_SIZE;
+        for (const auto& phdr : obj.phdrs) {
+            align = std::max(align, phdr.align);
         }
+        relocatable = Relocatable { align, !obj.dynamic_relocs->abs32.empty() || !obj.dynamic_relocs->abs32s.empty(),
+            options.relocate };
+    } else if (options.relocate) {
+        throw std::runtime_error("Cannot relocate an executable that was not linked with --pie");
+    }
+
+    LoaderStats stats;
+    ImageAddressSpace space(image_start, image_end, stats, relocatable);
 
-        // First, copy the section data
+    for (const auto& phdr : obj.phdrs) {
         auto it = obj.sections.find(phdr.name);
         if (it == obj.sections.end()) {
             throw std::runtime_error("Section not found: " + phdr.name);
         }
 
-        // BSS段不需要复制数据，因为mmap已经返回零初始化的内存
-        if (phdr.name != ".bss" && !phdr.name.starts_with(".bss.")) {
-            memcpy(addr, it->second.data.data(), phdr.size);
+        // BSS段不需要复制数据，因为预留的区间已经是零初始化的内存
+        auto copy_data = [&] {
+            if (!is_bss_section(phdr.name)) {
+                memcpy(space.at(phdr.vaddr), it->second.data.data(), phdr.size);
+            }
+        };
+
+        if (phdr.align >= HUGE_PAGE_SIZE) {
+            const uint64_t length = mapped_length(phdr);
+            // 先请求透明大页，复制数据时的首次缺页即可分配大页
+            space.advise_hugepage(phdr.vaddr, length);
+            const size_t huge_before = anon_huge_kb(space.at(phdr.vaddr));
+            copy_data();
+
+            const char* backing = "THP";
+            if (anon_huge_kb(space.at(phdr.vaddr)) <= huge_before) {
+                // 透明大页不可用时改用 hugetlbfs 预留的大页，再不行就保持普通页
+                backing = "hugetlb";
+                if (space.remap(phdr.vaddr, length, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) == MAP_FAILED) {
+                    backing = "none (4 KiB pages)";
+                    if (space.remap(phdr.vaddr, length, PROT_READ | PROT_WRITE, MAP_ANONYMOUS, -1, 0) == MAP_FAILED) {
+                        throw system_error("mmap");
+                    }
+                }
+                copy_data();
+            }
+            std::fprintf(stderr, "Huge pages for %s: %s\n", phdr.name.c_str(), backing);
+            space.protect(phdr.vaddr, length, to_prot(phdr.flags));
+        } else {
+            copy_data();
+            space.protect(phdr.vaddr, phdr.size, to_prot(phdr.flags));
         }
+    }
 
-        // Then, set the final permissions
-        mprotect(addr, phdr.size,
-            (phdr.flags & static_cast<uint32_t>(PHF::R) ? PROT_READ : 0)
-                | (phdr.flags & static_cast<uint32_t>(PHF::W) ? PROT_WRITE : 0)
-                | (phdr.flags & static_cast<uint32_t>(PHF::X) ? PROT_EXEC : 0));
+    // 数据都在可写的页里，先修正绝对地址再收紧权限
+    if (space.bias != 0) {
+        apply_dynamic_relocs(*obj.dynamic_relocs, space);
+    }
+    if (syscall_hook) {
+        patch_syscall(obj, space, syscall_hook);
     }
 
-    using FuncType = int (*)();
-    FuncType func = reinterpret_cast<FuncType>(obj.entry);
-    func();
+    // Then, set the final permissions
+    space.commit();
+    report(options, space, obj.phdrs.size(), stats);
+    return LoadedImage { obj.entry + space.bias, space.start + space.bias, space.end + space.bias };
+}
 
-    // Should not reach here, since `func` is NoReturn.
-    assert(false);
-}
\ No newline at end of file
+// 快照文件：第一页是头部、段表与可执行文件的路径，之后是各段映射后的内容，
+// 每段从页边界开始，恢复时直接把文件页私有映射到原来的地址。地址都是重定位之后的
+// 实际地址；带动态重定位表的映像还在末尾保存这张表（同样换算成实际地址），
+// 原来的区间被占用时整体平移后再修正
+constexpr char SNAPSHOT_MAGIC[8] = { 'F', 'L', 'E', 'S', 'N', 'A', 'P', '\0' };
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t segment_count;
+    uint64_t entry;
+    // 拍快照时可执行文件的身份，恢复前逐项核对，程序改过之后旧快照不能再用
+    uint64_t exe_size;
+    uint64_t exe_mtime; // 纳秒
+    uint64_t exe_inode;
+    uint32_t exe_path_length; // 绝对路径紧跟在段表之后，不含结尾的 '\0'
+    uint32_t below_2g; // 有 32 位绝对地址，平移后仍要落在低 2 GiB
+    uint64_t align; // 最大的段对齐；0 表示没有动态重定位表，不能平移
+    uint64_t relocs_offset; // abs64、abs32、abs32s 三个数组依次排列
+    uint64_t abs64_count;
+    uint64_t abs32_count;
+    uint64_t abs32s_count;
+};
+
+struct SnapshotSegment {
+    uint64_t vaddr; // 页对齐
+    uint64_t length; // 页对齐（大页段为 2 MiB 的倍数）
+    uint64_t offset; // 内容在文件中的偏移，0 表示全零（BSS），不占文件空间
+    uint32_t prot;
+    uint32_t huge; // 恢复后建议内核使用透明大页
+};
+
+constexpr size_t MAX_SNAPSHOT_SEGMENTS = (PAGE_SIZE - sizeof(SnapshotHeader)) / sizeof(SnapshotSegment);
+
+uint64_t mtime_ns(const struct stat& st)
+{
+    return static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000 + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+}
+
+// 读出快照末尾的动态重定位表，表项数先与文件大小核对
+DynamicRelocs read_snapshot_relocs(int fd, const SnapshotHeader& header, const std::string& filename)
+{
+    struct stat st;
+    const uint64_t count = header.abs64_count + header.abs32_count + header.abs32s_count;
+    if (fstat(fd, &st) < 0 || header.abs64_count > count || header.abs32_count > count
+        || header.relocs_offset > static_cast<uint64_t>(st.st_size)
+        || count > (static_cast<uint64_t>(st.st_size) - header.relocs_offset) / sizeof(uint64_t)) {
+        throw std::runtime_error("Truncated relocation table in snapshot: " + filename);
+    }
+    std::vector<uint64_t> table(count);
+    const auto bytes = static_cast<ssize_t>(count * sizeof(uint64_t));
+    if (pread(fd, table.data(), bytes, static_cast<off_t>(header.relocs_offset)) != bytes) {
+        throw std::runtime_error("Truncated relocation table in snapshot: " + filename);
+    }
+    DynamicRelocs relocs;
+    auto next = table.begin();
+    relocs.abs64.assign(next, next + header.abs64_count);
+    next += header.abs64_count;
+    relocs.abs32.assign(next, next + header.abs32_count);
+    next += header.abs32_count;
+    relocs.abs32s.assign(next, table.end());
+    return relocs;
+}
+
+// 把快照映射回原来的地址（被占用且可平移时换一段空闲区间），返回入口地址
+uint64_t map_snapshot(const std::string& filename, const ExecOptions& options)
+{
+    LoaderStats stats;
+    ++stats.file;
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+
+    // 头部、段表与路径在同一页里，一次读完
+    std::vector<uint8_t> page(PAGE_SIZE);
+    ++stats.file;
+    const ssize_t got = pread(fd, page.data(), page.size(), 0);
+    SnapshotHeader header;
+    std::memcpy(&header, page.data(), sizeof(header));
+    const size_t table_end = sizeof(header) + header.segment_count * sizeof(SnapshotSegment);
+    if (got < static_cast<ssize_t>(sizeof(header)) || std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+        || header.version != SNAPSHOT_VERSION || header.segment_count == 0
+        || header.segment_count > MAX_SNAPSHOT_SEGMENTS || header.exe_path_length == 0
+        || static_cast<size_t>(got) < table_end + header.exe_path_length) {
+        close(fd);
+        throw std::runtime_error("Not an FLE snapshot: " + filename);
+    }
+    std::vector<SnapshotSegment> segments(header.segment_count);
+    std::memcpy(segments.data(), page.data() + sizeof(header), segments.size() * sizeof(SnapshotSegment));
+    const std::string executable(reinterpret_cast<const char*>(page.data() + table_end), header.exe_path_length);
+
+    struct stat st;
+    ++stats.file;
+    if (stat(executable.c_str(), &st) < 0 || static_cast<uint64_t>(st.st_size) != header.exe_size
+        || mtime_ns(st) != header.exe_mtime || st.st_ino != header.exe_inode) {
+        close(fd);
+        throw std::runtime_error("Snapshot " + filename + " does not match its executable " + executable
+            + " (changed or removed since the snapshot was taken)");
+    }
+
+    std::vector<Extent> extents;
+    uint64_t image_start = UINT64_MAX, image_end = 0;
+    for (const auto& segment : segments) {
+        if (segment.vaddr % PAGE_SIZE != 0 || segment.length % PAGE_SIZE != 0 || segment.offset % PAGE_SIZE != 0) {
+            close(fd);
+            throw std::runtime_error("Malformed segment in snapshot: " + filename);
+        }
+        extents.push_back({ segment.vaddr, segment.vaddr + segment.length });
+        image_start = std::min(image_start, segment.vaddr);
+        image_end = std::max(image_end, segment.vaddr + segment.length);
+    }
+    check_overlaps(extents);
+
+    // 记录的区间被占用时，可平移的快照由内核另挑一段，不可平移的直接报错
+    std::optional<Relocatable> relocatable;
+    if (header.align) {
+        relocatable = Relocatable { header.align, header.below_2g != 0, false };
+    }
+    ImageAddressSpace space(image_start, image_end, stats, relocatable);
+    const bool moved = space.bias != 0;
+    for (const auto& segment : segments) {
+        if (segment.offset) {
+            // 平移后要改写段内的绝对地址，先以可写映射，commit 时再收紧
+            const int prot = moved ? static_cast<int>(segment.prot) | PROT_WRITE : static_cast<int>(segment.prot);
+            if (space.remap(segment.vaddr, segment.length, prot, 0, fd, segment.offset) == MAP_FAILED) {
+                close(fd);
+                throw system_error("mmap");
+            }
+        }
+        if (segment.huge) {
+            space.advise_hugepage(segment.vaddr, segment.length);
+        }
+        space.protect(segment.vaddr, segment.length, segment.prot);
+    }
+    DynamicRelocs relocs;
+    if (moved) {
+        stats.file += 2;
+        try {
+            relocs = read_snapshot_relocs(fd, header, filename);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+    ++stats.file;
+    close(fd);
+    if (moved) {
+        apply_dynamic_relocs(relocs, space);
+    }
+
+    space.commit();
+    report(options, space, segments.size(), stats);
+    return header.entry + space.bias;
+}
+
+} // anonymous namespace
+
+void FLE_exec_elf(const std::string& filename, const ExecOptions& options)
+{
+    if (options.perf_counters) {
+        const int status = FLE_perf_counters(filename, *options.perf_counters, [&] { return map_elf(filename, options); });
+        std::fflush(nullptr);
+        std::exit(status);
+    }
+    if (options.syscall_stats) {
+        // ELF 可执行文件的符号没有载入，调用点只能报告地址
+        const int status = FLE_syscall_stats(FLEObject {}, [&] { return map_elf(filename, options); });
+        std::fflush(nullptr);
+        std::exit(status);
+    }
+    run_entry(map_elf(filename, options));
+}
+
+void FLE_exec(const FLEObject& obj, const ExecOptions& options)
+{
+    if (options.profile) {
+        // 程序在子进程中运行，这里用它的退出码结束
+        const int status = FLE_profile(obj, *options.profile, [&] { return map_fle(obj, options).entry; });
+        std::fflush(nullptr);
+        std::exit(status);
+    }
+    if (options.perf_counters) {
+        const int status = FLE_perf_counters(obj.name, *options.perf_counters, [&] { return map_fle(obj, options).entry; });
+        std::fflush(nullptr);
+        std::exit(status);
+    }
+    if (options.syscall_stats) {
+        const int status = FLE_syscall_stats(obj, [&] { return map_fle(obj, options).entry; });
+        std::fflush(nullptr);
+        std::exit(status);
+    }
+    run_entry(map_fle(obj, options).entry);
+}
+
+uint64_t FLE_load_exec(const std::string& filename, const ExecOptions& options)
+{
+    return is_elf_file(filename) ? map_elf(filename, options) : map_fle(load_fle(filename), options).entry;
+}
+
+void FLE_write_snapshot(const std::string& filename, const std::string& path, const ExecOptions& options)
+{
+    // 先记下可执行文件的身份，再载入内容
+    struct stat st;
+    char* resolved = realpath(filename.c_str(), nullptr);
+    if (!resolved || stat(resolved, &st) < 0) {
+        std::free(resolved);
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+    const std::string executable = resolved;
+    std::free(resolved);
+    const FLEObject obj = load_fle(filename);
+
+    const LoadedImage image = map_fle(obj, options);
+    const uint64_t bias = image.entry - obj.entry;
+
+    std::vector<ProgramHeader> phdrs = obj.phdrs;
+    std::sort(phdrs.begin(), phdrs.end(), [](const ProgramHeader& a, const ProgramHeader& b) { return a.vaddr < b.vaddr; });
+    if (phdrs.size() > MAX_SNAPSHOT_SEGMENTS
+        || sizeof(SnapshotHeader) + phdrs.size() * sizeof(SnapshotSegment) + executable.size() > PAGE_SIZE) {
+        throw std::runtime_error("Too many segments for a snapshot: " + obj.name);
+    }
+
+    SnapshotHeader header {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.segment_count = static_cast<uint32_t>(phdrs.size());
+    header.entry = image.entry;
+    header.exe_size = static_cast<uint64_t>(st.st_size);
+    header.exe_mtime = mtime_ns(st);
+    header.exe_inode = st.st_ino;
+    header.exe_path_length = static_cast<uint32_t>(executable.size());
+
+    std::vector<SnapshotSegment> segments;
+    uint64_t offset = PAGE_SIZE;
+    for (const auto& phdr : phdrs) {
+        SnapshotSegment segment {
+            .vaddr = page_down(phdr.vaddr) + bias,
+            .length = mapped_length(phdr),
+            .offset = 0,
+            .prot = static_cast<uint32_t>(to_prot(phdr.flags)),
+            .huge = phdr.align >= HUGE_PAGE_SIZE,
+        };
+        if (!is_bss_section(phdr.name)) {
+            if (!(segment.prot & PROT_READ)) {
+                throw std::runtime_error("Cannot snapshot unreadable segment: " + phdr.name);
+            }
+            segment.offset = offset;
+            offset += segment.length;
+        }
+        segments.push_back(segment);
+    }
+
+    // 重定位表换算成快照中的地址，恢复时与段表用同一套坐标
+    std::vector<uint64_t> relocs;
+    if (obj.dynamic_relocs) {
+        header.align = PAGE_SIZE;
+        for (const auto& phdr : obj.phdrs) {
+            header.align = std::max(header.align, phdr.align);
+        }
+        header.below_2g = !obj.dynamic_relocs->abs32.empty() || !obj.dynamic_relocs->abs32s.empty();
+        header.relocs_offset = offset;
+        header.abs64_count = obj.dynamic_relocs->abs64.size();
+        header.abs32_count = obj.dynamic_relocs->abs32.size();
+        header.abs32s_count = obj.dynamic_relocs->abs32s.size();
+        for (const auto* table : { &obj.dynamic_relocs->abs64, &obj.dynamic_relocs->abs32, &obj.dynamic_relocs->abs32s }) {
+            for (uint64_t addr : *table) {
+                relocs.push_back(addr + bias);
+            }
+        }
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot write snapshot: " + path);
+    }
+    std::vector<char> page(PAGE_SIZE);
+    std::memcpy(page.data(), &header, sizeof(header));
+    std::memcpy(page.data() + sizeof(header), segments.data(), segments.size() * sizeof(SnapshotSegment));
+    std::memcpy(page.data() + sizeof(header) + segments.size() * sizeof(SnapshotSegment), executable.data(),
+        executable.size());
+    out.write(page.data(), page.size());
+    // 内容取自已经映射并重定位好的映像，与直接运行时入口处看到的完全一样
+    for (const auto& segment : segments) {
+        if (segment.offset) {
+            out.write(reinterpret_cast<const char*>(segment.vaddr), segment.length);
+        }
+    }
+    out.write(reinterpret_cast<const char*>(relocs.data()), static_cast<std::streamsize>(relocs.size() * sizeof(uint64_t)));
+    if (!out.flush()) {
+        throw std::runtime_error("Cannot write snapshot: " + path);
+    }
+    FLE_unmap_image(image);
+
+    std::fprintf(stderr, "Snapshot: %s, %zu segments, %lu bytes, entry 0x%lx\n", path.c_str(), segments.size(),
+        static_cast<unsigned long>(offset + relocs.size() * sizeof(uint64_t)), static_cast<unsigned long>(image.entry));
+}
+
+void FLE_exec_snapshot(const std::string& filename, const ExecOptions& options)
+{
+    // 与 ELF 可执行文件一样没有符号表
+    if (options.perf_counters) {
+        const int status = FLE_perf_counters(filename, *options.perf_counters, [&] { return map_snapshot(filename, options); });
+        std::fflush(nullptr);
+        std::exit(status);
+    }
+    if (options.syscall_stats) {
+        const int status = FLE_syscall_stats(FLEObject {}, [&] { return map_snapshot(filename, options); });
+        std::fflush(nullptr);
+        std::exit(status);
+    }
+    run_entry(map_snapshot(filename, options));
+}
+
+LoadedImage FLE_map_image(const FLEObject& obj, const ExecOptions& options, uint64_t syscall_hook)
+{
+    return map_fle(obj, options, syscall_hook);
+}
+
+void FLE_unmap_image(const LoadedImage& image)
+{
+    munmap(reinterpret_cast<void*>(image.start), image.end - image.start);
+}
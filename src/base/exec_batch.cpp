@@ -0,0 +1,200 @@
+#include "fle.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csetjmp>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 批量宿主：多个 --pie 程序各自装在本进程的不同基址上，由线程池轮流运行。
+// 程序的系统调用都经过 minilibc 的 syscall()（可变参数函数，不会被内联），
+// 装载时把它改成跳到 batch_syscall：标准输出/错误写进各自的缓冲区，
+// exit 用 siglongjmp 回到工作线程，其余系统调用原样转发。
+// 程序运行在工作线程的栈上，出错（SIGSEGV 等）时同样跳回，只结束这一个程序。
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t ALT_STACK_SIZE = 64 * 1024;
+constexpr int FAULT_SIGNALS[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE };
+
+// 同一个文件只解析一次，每次运行各自装入一份映像
+struct Program {
+    std::once_flag parsed;
+    FLEObject obj;
+};
+
+struct Job {
+    std::string file;
+    Program* program;
+    std::string out;
+    std::string err;
+    std::string error; // 装载失败的原因
+    int status = 0;
+    int signal = 0;
+    double ms = 0;
+    sigjmp_buf exit_point;
+};
+
+// 工作线程当前运行的程序，不在运行程序时为空
+thread_local Job* current_job;
+
+// 与 minilibc 的 syscall(int num, ...) 参数寄存器一致，返回值同样是 -errno 约定
+long host_syscall(Job* job, long num, long a1, long a2, long a3, long a4)
+{
+    switch (static_cast<int>(num)) {
+    case SYS_write:
+        if (a1 == STDOUT_FILENO || a1 == STDERR_FILENO) {
+            (a1 == STDOUT_FILENO ? job->out : job->err).append(reinterpret_cast<const char*>(a2), a3);
+            return a3;
+        }
+        break;
+    case SYS_read:
+        // 程序之间没法分享同一个标准输入，读到的总是文件尾
+        if (a1 == STDIN_FILENO) {
+            return 0;
+        }
+        break;
+    case SYS_exit:
+    case SYS_exit_group:
+        job->status = static_cast<int>(a1) & 0xff;
+        siglongjmp(job->exit_point, 1);
+    default:
+        break;
+    }
+    const long result = ::syscall(static_cast<int>(num), a1, a2, a3, a4);
+    return result < 0 ? -errno : result;
+}
+
+// 系统调用期间运行的是宿主代码：清掉 current_job，这时出错就是宿主自己的错误，
+// 不能当成程序崩溃跳回去（那样会丢掉宿主持有的锁和半改的状态）
+long batch_syscall(long num, long a1, long a2, long a3, long a4)
+{
+    Job* job = current_job;
+    current_job = nullptr;
+    const long result = host_syscall(job, num, a1, a2, a3, a4);
+    current_job = job;
+    return result;
+}
+
+void on_fault(int sig, siginfo_t*, void*)
+{
+    if (Job* job = current_job) {
+        job->signal = sig;
+        siglongjmp(job->exit_point, 1);
+    }
+    // 宿主自己出错：恢复默认处理，返回后重新执行出错的指令
+    std::signal(sig, SIG_DFL);
+}
+
+void run_job(Job& job, const ExecOptions& options)
+{
+    const auto start = Clock::now();
+    try {
+        std::call_once(job.program->parsed, [&] { job.program->obj = load_fle(job.file); });
+        const LoadedImage image = FLE_map_image(job.program->obj, options, reinterpret_cast<uint64_t>(&batch_syscall));
+        current_job = &job;
+        if (sigsetjmp(job.exit_point, 1) == 0) {
+            using FuncType = int (*)();
+            reinterpret_cast<FuncType>(image.entry)();
+            job.status = 127; // _start 以 exit 系统调用结束，不应返回
+        }
+        current_job = nullptr;
+        FLE_unmap_image(image);
+    } catch (const std::exception& e) {
+        job.error = e.what();
+    }
+    job.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void worker(std::vector<Job>& jobs, std::atomic<size_t>& next, const ExecOptions& options)
+{
+    // 栈溢出时处理函数也要有栈可用
+    std::vector<char> alt_stack(ALT_STACK_SIZE);
+    stack_t ss {};
+    ss.ss_sp = alt_stack.data();
+    ss.ss_size = alt_stack.size();
+    sigaltstack(&ss, nullptr);
+
+    for (size_t i; (i = next.fetch_add(1)) < jobs.size();) {
+        run_job(jobs[i], options);
+    }
+
+    ss.ss_flags = SS_DISABLE;
+    sigaltstack(&ss, nullptr);
+}
+
+std::string describe(const Job& job)
+{
+    if (!job.error.empty()) {
+        return "error: " + job.error;
+    }
+    if (job.signal) {
+        return "signal " + std::to_string(job.signal) + " (" + strsignal(job.signal) + ")";
+    }
+    return "exit " + std::to_string(job.status);
+}
+
+} // anonymous namespace
+
+int FLE_exec_batch(const std::vector<std::string>& files, unsigned threads, const ExecOptions& options)
+{
+    std::map<std::string, Program> programs;
+    std::vector<Job> jobs(files.size());
+    for (size_t i = 0; i != files.size(); ++i) {
+        jobs[i].file = files[i];
+        jobs[i].program = &programs[files[i]];
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, jobs.size()));
+
+    struct sigaction action {};
+    action.sa_sigaction = on_fault;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (int sig : FAULT_SIGNALS) {
+        sigaction(sig, &action, nullptr);
+    }
+
+    const auto start = Clock::now();
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i != threads; ++i) {
+        pool.emplace_back(worker, std::ref(jobs), std::ref(next), std::cref(options));
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    const double total_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    for (int sig : FAULT_SIGNALS) {
+        std::signal(sig, SIG_DFL);
+    }
+
+    // 按参数顺序输出，结果与线程调度无关
+    bool failed = false;
+    for (size_t i = 0; i != jobs.size(); ++i) {
+        const auto& job = jobs[i];
+        std::cout << job.out << std::flush;
+        std::cerr << job.err;
+        std::fprintf(stderr, "Batch [%zu] %s: %s, %.3f ms\n", i + 1, job.file.c_str(), describe(job).c_str(), job.ms);
+        failed |= !job.error.empty() || job.signal || job.status != 0;
+    }
+    std::fprintf(stderr, "Batch: %zu programs on %u threads, %.3f ms (%.3f ms per program)\n", jobs.size(), threads,
+        total_ms, jobs.empty() ? 0.0 : total_ms / jobs.size());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+#include "fle.hpp"
+#include "socket_utils.hpp"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// 协议：
+//   请求  一个字节的类型（'R' 运行，'Q' 关闭服务），运行请求随后是子进程的标准输入，写完后关闭写端
+//   应答  "<退出码> <耗时微秒> <stdout 长度> <stderr 长度>\n"，随后是子进程的标准输出与标准错误。
+//         请求没能运行时耗时为 -1，stderr 段是服务端的错误信息
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr char RUN_REQUEST = 'R';
+constexpr char SHUTDOWN_REQUEST = 'Q';
+
+double elapsed_ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// 与 shell 相同的约定：被信号杀死时为 128 + 信号编号
+int exit_code(int status)
+{
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+std::string describe(int status)
+{
+    return WIFEXITED(status) ? "exit " + std::to_string(WEXITSTATUS(status))
+                             : "signal " + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+}
+
+// 子进程的输入与输出都放进匿名内存文件：不受管道容量限制，
+// 两路输出也不必边读边等，子进程结束后从头读出即可
+class MemFile {
+public:
+    explicit MemFile(const std::string& contents = {})
+        : fd(memfd_create("fle-io", MFD_CLOEXEC))
+    {
+        if (fd < 0) {
+            throw system_error("memfd_create");
+        }
+        write_all(fd, contents);
+        ::lseek(fd, 0, SEEK_SET);
+    }
+    ~MemFile() { ::close(fd); }
+    MemFile(const MemFile&) = delete;
+    MemFile& operator=(const MemFile&) = delete;
+
+    std::string contents() const
+    {
+        ::lseek(fd, 0, SEEK_SET);
+        return read_all(fd);
+    }
+
+    const int fd;
+};
+
+// 派生一个子进程直接跳到已映射好的入口，返回 wait 状态。
+// out/err 为空时子进程沿用服务进程的标准输出与标准错误；close_in_child 是服务自己的描述符
+int run_once(uint64_t entry, const std::string& input, std::string* out, std::string* err, const std::vector<int>& close_in_child)
+{
+    const MemFile in(input);
+    std::optional<MemFile> out_file, err_file;
+    if (out) {
+        out_file.emplace();
+    }
+    if (err) {
+        err_file.emplace();
+    }
+    // 子进程从不冲刷 C++ 流，缓冲区里残留的内容只会由父进程写出一次
+    std::cout.flush();
+    std::fflush(nullptr);
+
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        throw system_error("fork");
+    }
+    if (pid == 0) {
+        std::signal(SIGPIPE, SIG_DFL);
+        ::dup2(in.fd, STDIN_FILENO);
+        if (out_file) {
+            ::dup2(out_file->fd, STDOUT_FILENO);
+        }
+        if (err_file) {
+            ::dup2(err_file->fd, STDERR_FILENO);
+        }
+        for (int fd : close_in_child) {
+            ::close(fd);
+        }
+        using FuncType = int (*)();
+        reinterpret_cast<FuncType>(entry)();
+        // _start 以 exit 系统调用结束，不应返回
+        ::_exit(127);
+    }
+
+    int status;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            throw system_error("waitpid");
+        }
+    }
+    if (out) {
+        *out = out_file->contents();
+    }
+    if (err) {
+        *err = err_file->contents();
+    }
+    return status;
+}
+
+int serve_stdin(uint64_t entry)
+{
+    size_t runs = 0;
+    double total_ms = 0;
+    int last = 0;
+    for (std::string line; std::getline(std::cin, line);) {
+        const auto start = Clock::now();
+        const int status = run_once(entry, line + "\n", nullptr, nullptr, {});
+        const double ms = elapsed_ms(start);
+        total_ms += ms;
+        last = exit_code(status);
+        std::fprintf(stderr, "Run %zu: %s, %.3f ms\n", ++runs, describe(status).c_str(), ms);
+    }
+    std::fprintf(stderr, "Fork server: %zu runs, %.3f ms per run\n", runs, runs ? total_ms / runs : 0.0);
+    return last;
+}
+
+int serve_socket(uint64_t entry, const std::string& socket_path)
+{
+    // 客户端提前断开时不要被 SIGPIPE 杀掉
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listener = listen_socket(socket_path, SOCK_CLOEXEC);
+    std::cout << "Fork server listening on " << socket_path << std::endl;
+
+    size_t runs = 0;
+    double total_ms = 0;
+    for (bool running = true; running;) {
+        int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR)
+                continue;
+            throw system_error("accept");
+        }
+
+        std::string out, err;
+        int status = 0;
+        long micros = -1;
+        try {
+            const std::string request = read_all(client);
+            if (request.empty() || (request[0] != RUN_REQUEST && request[0] != SHUTDOWN_REQUEST)) {
+                throw std::runtime_error("Malformed request");
+            }
+            if (request[0] == SHUTDOWN_REQUEST) {
+                out = "Fork server shutting down\n";
+                running = false;
+            } else {
+                const auto start = Clock::now();
+                const int wait_status = run_once(entry, request.substr(1), &out, &err, { listener, client });
+                const double ms = elapsed_ms(start);
+                total_ms += ms;
+                micros = static_cast<long>(ms * 1000);
+                status = exit_code(wait_status);
+                std::fprintf(stderr, "Run %zu: %s, %.3f ms\n", ++runs, describe(wait_status).c_str(), ms);
+            }
+        } catch (const std::exception& e) {
+            err += std::string("Error: ") + e.what() + "\n";
+            status = 1;
+        }
+
+        try {
+            write_all(client, std::to_string(status) + " " + std::to_string(micros) + " " + std::to_string(out.size())
+                    + " " + std::to_string(err.size()) + "\n");
+            write_all(client, out);
+            write_all(client, err);
+        } catch (const std::exception& e) {
+            std::cerr << "Fork server: " << e.what() << std::endl;
+        }
+        ::close(client);
+    }
+
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    std::fprintf(stderr, "Fork server: %zu runs, %.3f ms per run\n", runs, runs ? total_ms / runs : 0.0);
+    return 0;
+}
+
+} // anonymous namespace
+
+int FLE_exec_server(const std::string& filename, const std::string& socket_path, const ExecOptions& options)
+{
+    // 解析与映射只做一次；每个请求派生的子进程继承映射好的映像（写时复制），数据段总是初始状态
+    const auto start = Clock::now();
+    const uint64_t entry = FLE_load_exec(filename, options);
+    std::fprintf(stderr, "Fork server: %s mapped in %.3f ms\n", filename.c_str(), elapsed_ms(start));
+
+    return socket_path.empty() ? serve_stdin(entry) : serve_socket(entry, socket_path);
+}
+
+int FLE_exec_connect(const std::string& socket_path, bool shutdown)
+{
+    int fd = connect_socket(socket_path, "fork server");
+
+    std::string request(1, shutdown ? SHUTDOWN_REQUEST : RUN_REQUEST);
+    if (!shutdown) {
+        request += read_all(STDIN_FILENO);
+    }
+    write_all(fd, request);
+    ::shutdown(fd, SHUT_WR);
+
+    const std::string response = read_all(fd);
+    ::close(fd);
+
+    int status;
+    long micros;
+    size_t out_size, err_size;
+    std::istringstream header(response.substr(0, response.find('\n')));
+    const size_t body = response.find('\n') + 1;
+    if (!(header >> status >> micros >> out_size >> err_size) || body == 0
+        || body + out_size + err_size != response.size()) {
+        throw std::runtime_error("Malformed response from fork server");
+    }
+    std::cout << std::string_view(response).substr(body, out_size) << std::flush;
+    std::cerr << std::string_view(response).substr(body + out_size, err_size) << std::flush;
+    if (!shutdown && micros >= 0) {
+        std::fprintf(stderr, "Fork server run: exit %d, %.3f ms\n", status, micros / 1000.0);
+    }
+    return status;
+}
@@ -0,0 +1,261 @@
+#include "fle.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 布局文件是 GNU ld 链接脚本的一个子集：
+//
+//   SECTIONS
+//   {
+//       . = 0x800000;                              基址，只能出现在第一个输出节之前
+//       .text ALIGN(0x200000) : { *(.text.hot) *(.text .text.*) }
+//       .data.hot : SUBALIGN(64) { main.fle(.data.hot) }
+//       .secret FLAGS(r) : { *(.rodata.secret) }
+//   }
+//
+// 输出节按出现顺序排列；输入节描述为 文件名通配符(节名通配符 ...)，
+// 按顺序取第一条匹配的规则。FLAGS 是本实现的扩展，取 r/w/x 的组合；
+// 没有 FLAGS 时输出节的权限取所含输入节（.text*/.rodata*/.data*/.bss*）权限的并集。
+// 注释可以用 /* ... */ 或 #
+
+namespace {
+
+struct Token {
+    std::string text;
+    size_t line;
+};
+
+bool is_punct(char c)
+{
+    return c == '{' || c == '}' || c == '(' || c == ')' || c == ':' || c == ';' || c == '=';
+}
+
+std::vector<Token> tokenize(const std::string& text, const std::string& filename)
+{
+    std::vector<Token> tokens;
+    size_t line = 1;
+    for (size_t i = 0; i < text.size();) {
+        const char c = text[i];
+        if (c == '\n') {
+            ++line;
+            ++i;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (c == '#') {
+            i = text.find('\n', i);
+            i = i == std::string::npos ? text.size() : i;
+        } else if (text.compare(i, 2, "/*") == 0) {
+            const size_t end = text.find("*/", i + 2);
+            if (end == std::string::npos) {
+                throw std::runtime_error(filename + ":" + std::to_string(line) + ": unterminated comment");
+            }
+            line += std::count(text.begin() + i, text.begin() + end, '\n');
+            i = end + 2;
+        } else if (is_punct(c)) {
+            tokens.push_back({ std::string(1, c), line });
+            ++i;
+        } else {
+            size_t end = i;
+            while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end])) && !is_punct(text[end])
+                && text.compare(end, 2, "/*") != 0) {
+                ++end;
+            }
+            tokens.push_back({ text.substr(i, end - i), line });
+            i = end;
+        }
+    }
+    return tokens;
+}
+
+class LayoutParser {
+public:
+    LayoutParser(std::vector<Token> tokens, std::string filename)
+        : tokens(std::move(tokens))
+        , filename(std::move(filename))
+    {
+    }
+
+    LinkLayout parse()
+    {
+        LinkLayout layout;
+        while (!at_end()) {
+            expect("SECTIONS");
+            expect("{");
+            while (!accept("}")) {
+                if (accept(".")) {
+                    expect("=");
+                    if (!layout.sections.empty() || layout.base) {
+                        fail("the location counter can only be set once, before the first output section");
+                    }
+                    layout.base = number();
+                    if (*layout.base % 0x1000 != 0) {
+                        fail("base address must be page aligned");
+                    }
+                    expect(";");
+                } else {
+                    layout.sections.push_back(output_section());
+                }
+            }
+        }
+        return layout;
+    }
+
+private:
+    OutputSectionRule output_section()
+    {
+        OutputSectionRule rule;
+        rule.name = word();
+        for (std::string attr; (attr = peek()) != ":";) {
+            next();
+            expect("(");
+            if (attr == "ALIGN") {
+                rule.align = alignment();
+            } else if (attr == "FLAGS") {
+                rule.flags = permissions(word());
+            } else {
+                fail("unknown output section attribute " + attr);
+            }
+            expect(")");
+        }
+        expect(":");
+        if (accept("SUBALIGN")) {
+            expect("(");
+            rule.subalign = alignment();
+            expect(")");
+        }
+        expect("{");
+        while (!accept("}")) {
+            InputSectionRule input;
+            input.file = word();
+            expect("(");
+            while (!accept(")")) {
+                input.sections.push_back(word());
+            }
+            if (input.sections.empty()) {
+                fail("empty input section list in " + rule.name);
+            }
+            rule.inputs.push_back(std::move(input));
+        }
+        return rule;
+    }
+
+    uint64_t number()
+    {
+        const std::string text = word();
+        size_t pos = 0;
+        uint64_t value;
+        try {
+            value = std::stoull(text, &pos, 0);
+        } catch (const std::exception&) {
+            fail("expected a number, got " + text);
+        }
+        if (pos + 1 == text.size() && text[pos] == 'K') {
+            return value << 10;
+        }
+        if (pos + 1 == text.size() && text[pos] == 'M') {
+            return value << 20;
+        }
+        if (pos != text.size()) {
+            fail("expected a number, got " + text);
+        }
+        return value;
+    }
+
+    uint64_t alignment()
+    {
+        const uint64_t value = number();
+        if (value == 0 || (value & (value - 1)) != 0) {
+            fail("alignment must be a power of two");
+        }
+        return value;
+    }
+
+    uint32_t permissions(const std::string& text)
+    {
+        uint32_t flags = 0;
+        for (char c : text) {
+            switch (c) {
+            case 'r':
+                flags |= static_cast<uint32_t>(PHF::R);
+                break;
+            case 'w':
+                flags |= static_cast<uint32_t>(PHF::W);
+                break;
+            case 'x':
+                flags |= static_cast<uint32_t>(PHF::X);
+                break;
+            default:
+                fail("unknown permission '" + std::string(1, c) + "' in FLAGS(" + text + ")");
+            }
+        }
+        return flags;
+    }
+
+    std::string word()
+    {
+        const auto& token = next();
+        if (token.text.size() == 1 && is_punct(token.text[0])) {
+            fail("unexpected '" + token.text + "'");
+        }
+        return token.text;
+    }
+
+    bool at_end() const { return pos == tokens.size(); }
+
+    const std::string& peek()
+    {
+        if (at_end()) {
+            fail("unexpected end of file");
+        }
+        return tokens[pos].text;
+    }
+
+    const Token& next()
+    {
+        peek();
+        return tokens[pos++];
+    }
+
+    bool accept(const std::string& text)
+    {
+        if (!at_end() && tokens[pos].text == text) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(const std::string& text)
+    {
+        if (!accept(text)) {
+            fail("expected '" + text + "'" + (at_end() ? "" : ", got '" + tokens[pos].text + "'"));
+        }
+    }
+
+    [[noreturn]] void fail(const std::string& message) const
+    {
+        const size_t line = tokens.empty() ? 1 : tokens[std::min(pos, tokens.size() - 1)].line;
+        throw std::runtime_error(filename + ":" + std::to_string(line) + ": " + message);
+    }
+
+    std::vector<Token> tokens;
+    std::string filename;
+    size_t pos = 0;
+};
+
+} // anonymous namespace
+
+LinkLayout load_layout(const std::string& filename)
+{
+    std::ifstream in(filename);
+    if (!in) {
+        throw std::runtime_error("Cannot open layout file: " + filename);
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    return LayoutParser(tokenize(buffer.str(), filename), filename).parse();
+}
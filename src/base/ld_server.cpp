@@ -0,0 +1,190 @@
+#include "fle.hpp"
+#include "socket_utils.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// 协议：
+//   请求  客户端工作目录与各个参数，每项以 '\0' 结尾，写完后关闭写端
+//   应答  "<退出码> <stdout 长度> <stderr 长度>\n"，随后是两段输出
+
+namespace {
+
+const std::string SHUTDOWN_REQUEST = "--shutdown";
+
+std::vector<std::string> split_request(const std::string& request)
+{
+    std::vector<std::string> fields;
+    size_t begin = 0;
+    for (size_t end; (end = request.find('\0', begin)) != std::string::npos; begin = end + 1) {
+        fields.push_back(request.substr(begin, end - begin));
+    }
+    return fields;
+}
+
+// 处理请求期间把 std::cout/std::cerr 改写到请求自己的缓冲区，无论怎样离开作用域都还原
+class RedirectStreams {
+public:
+    RedirectStreams(std::ostream& out, std::ostream& err)
+        : saved_out(std::cout.rdbuf(out.rdbuf()))
+        , saved_err(std::cerr.rdbuf(err.rdbuf()))
+    {
+    }
+    ~RedirectStreams()
+    {
+        std::cout.rdbuf(saved_out);
+        std::cerr.rdbuf(saved_err);
+    }
+    RedirectStreams(const RedirectStreams&) = delete;
+    RedirectStreams& operator=(const RedirectStreams&) = delete;
+
+private:
+    std::streambuf* saved_out;
+    std::streambuf* saved_err;
+};
+
+// 已解析的目标文件，文件的修改时间或大小变化后失效
+class ObjectCache {
+public:
+    std::shared_ptr<const FLEObject> load(const std::string& file)
+    {
+        const auto path = std::filesystem::absolute(file).lexically_normal().string();
+        const auto mtime = std::filesystem::last_write_time(path);
+        const auto size = std::filesystem::file_size(path);
+
+        auto it = entries.find(path);
+        if (it != entries.end() && it->second.mtime == mtime && it->second.size == size) {
+            ++hits;
+            return it->second.object;
+        }
+        ++misses;
+        auto object = std::make_shared<const FLEObject>(load_object(path));
+        entries.insert_or_assign(path, Entry { mtime, size, object });
+        return object;
+    }
+
+    size_t hits = 0;
+    size_t misses = 0;
+
+private:
+    struct Entry {
+        std::filesystem::file_time_type mtime;
+        uintmax_t size;
+        std::shared_ptr<const FLEObject> object; // 链接期间与链接器共享，不复制
+    };
+    std::map<std::string, Entry> entries;
+};
+
+} // anonymous namespace
+
+int FLE_ld_server(const std::string& socket_path)
+{
+    // 客户端提前断开时不要被 SIGPIPE 杀掉
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listener = listen_socket(socket_path);
+    std::cout << "Linker server listening on " << socket_path << std::endl;
+
+    ObjectCache cache;
+    size_t total_hits = 0, total_lookups = 0;
+
+    for (bool running = true; running;) {
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR)
+                continue;
+            throw system_error("accept");
+        }
+
+        std::ostringstream out, err;
+        int status = 0;
+        try {
+            auto fields = split_request(read_all(client));
+            if (fields.empty()) {
+                throw std::runtime_error("Malformed request");
+            }
+            const std::vector<std::string> args(fields.begin() + 1, fields.end());
+
+            if (args.size() == 1 && args[0] == SHUTDOWN_REQUEST) {
+                out << "Linker server shutting down" << std::endl;
+                running = false;
+            } else {
+                // 请求逐个处理，相对路径按客户端的工作目录解析
+                std::filesystem::current_path(fields[0]);
+
+                // 先解析并检查参数，出错时还没有改写全局的输出流
+                const auto command = parse_ld_args(args);
+                if (command.run) {
+                    // 程序会在服务进程里运行并结束它
+                    throw std::runtime_error("--run is not supported by the linker server");
+                }
+                const size_t hits = cache.hits, misses = cache.misses;
+                {
+                    RedirectStreams redirect(out, err);
+                    run_ld(command, [&](const std::string& file) { return cache.load(file); });
+                }
+
+                total_hits += cache.hits - hits;
+                total_lookups += cache.hits - hits + cache.misses - misses;
+                out << "\nObject cache: " << cache.hits - hits << " hits, " << cache.misses - misses
+                    << " misses; overall hit rate " << (total_lookups ? 100 * total_hits / total_lookups : 0)
+                    << "% (" << total_hits << "/" << total_lookups << ")" << std::endl;
+            }
+        } catch (const std::exception& e) {
+            err << "Error: " << e.what() << std::endl;
+            status = 1;
+        }
+
+        const auto out_text = out.str(), err_text = err.str();
+        try {
+            write_all(client, std::to_string(status) + " " + std::to_string(out_text.size()) + " "
+                    + std::to_string(err_text.size()) + "\n");
+            write_all(client, out_text);
+            write_all(client, err_text);
+        } catch (const std::exception& e) {
+            std::cerr << "Linker server: " << e.what() << std::endl;
+        }
+        ::close(client);
+    }
+
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    return 0;
+}
+
+int FLE_ld_connect(const std::string& socket_path, const std::vector<std::string>& args)
+{
+    int fd = connect_socket(socket_path, "linker server");
+
+    std::string request = std::filesystem::current_path().string();
+    request += '\0';
+    for (const auto& arg : args) {
+        request += arg;
+        request += '\0';
+    }
+    write_all(fd, request);
+    ::shutdown(fd, SHUT_WR);
+
+    const std::string response = read_all(fd);
+    ::close(fd);
+
+    int status;
+    size_t out_size, err_size;
+    std::istringstream header(response.substr(0, response.find('\n')));
+    const size_t body = response.find('\n') + 1;
+    if (!(header >> status >> out_size >> err_size) || body == 0 || body + out_size + err_size != response.size()) {
+        throw std::runtime_error("Malformed response from linker server");
+    }
+    std::cout << std::string_view(response).substr(body, out_size) << std::flush;
+    std::cerr << std::string_view(response).substr(body + out_size, err_size) << std::flush;
+    return status;
+}
@@ -33,8 +33,9 @@ FLEObject load_fle(const std::string& file)
                 ProgramHeader phdr;
                 phdr.name = phdr_json["name"].get<std::string>();
                 phdr.vaddr = phdr_json["vaddr"].get<uint64_t>();
-                phdr.size = phdr_json["size"].get<uint32_t>();
+                phdr.size = phdr_json["size"].get<uint64_t>();
                 phdr.flags = phdr_json["flags"].get<uint32_t>();
+                phdr.align = phdr_json.value("align", phdr.align);
                 obj.phdrs.push_back(phdr);
             }
         }
@@ -51,11 +52,49 @@ FLEObject load_fle(const std::string& file)
                 obj.shdrs.push_back(shdr);
             }
         }
+        if (j.contains("build_id")) {
+            obj.build_id = j["build_id"].get<std::string>();
+        }
+        if (j.contains("symbols")) {
+            for (const auto& sym_json : j["symbols"]) {
+                const auto type = sym_json["type"].get<std::string>();
+                obj.symbols.push_back(Symbol {
+                    type == "local" ? SymbolType::LOCAL : type == "weak" ? SymbolType::WEAK
+                                                                         : SymbolType::GLOBAL,
+                    sym_json["section"].get<std::string>(),
+                    sym_json["addr"].get<size_t>(),
+                    sym_json["size"].get<size_t>(),
+                    sym_json["name"].get<std::string>() });
+            }
+        }
+        if (j.contains("dynamic_relocs")) {
+            const auto& relocs = j["dynamic_relocs"];
+            obj.dynamic_relocs = DynamicRelocs {
+                relocs["abs64"].get<std::vector<uint64_t>>(),
+                relocs["abs32"].get<std::vector<uint64_t>>(),
+                relocs["abs32s"].get<std::vector<uint64_t>>() };
+        }
+        if (j.contains("symbol_index")) {
+            for (const auto& entry : j["symbol_index"]) {
+                obj.symbol_index.push_back(SymbolIndexEntry {
+                    entry[0].get<uint64_t>(), entry[1].get<uint64_t>(), entry[2].get<size_t>() });
+            }
+        }
+    }
+
+    if (j.contains("groups")) {
+        for (const auto& group_json : j["groups"]) {
+            obj.groups.push_back(SectionGroup {
+                group_json["signature"].get<std::string>(),
+                group_json["sections"].get<std::vector<std::string>>() });
+        }
     }
 
     // 处理每个段
     for (auto& [key, value] : j.items()) {
-        if (key == "type" || key == "entry" || key == "phdrs" || key == "shdrs")
+        if (key == "type" || key == "entry" || key == "phdrs" || key == "shdrs" || key == "groups"
+            || key == "build_id" || key == "symbols" || key == "symbol_index"
+            || key == "dynamic_relocs")
             continue;
 
         FLESection section;
@@ -126,7 +165,7 @@ FLEObject load_fle(const std::string& file)
                 // 处理重定位
                 std::string reloc_str = trim(content);
                 // e.g. rel(n - 4)
-                std::regex reloc_pattern(R"(\.(rel|abs64|abs|abs32s)\(([\w.]+)\s*[-+]\s*(\d+)\))");
+                std::regex reloc_pattern(R"(\.(rel|abs64|abs|abs32s|gotpcrel|gotpcrelx|rexgotpcrelx)\(([\w.]+)\s*([-+])\s*([0-9a-fA-F]+)\))");
                 std::smatch match;
 
                 if (!std::regex_match(reloc_str, match, reloc_pattern)) {
@@ -142,15 +181,31 @@ FLEObject load_fle(const std::string& file)
                     type = RelocationType::R_X86_64_32;
                 } else if (match[1].str() == "abs32s") {
                     type = RelocationType::R_X86_64_32S;
+                } else if (match[1].str() == "gotpcrel") {
+                    type = RelocationType::R_X86_64_GOTPCREL;
+                } else if (match[1].str() == "gotpcrelx") {
+                    type = RelocationType::R_X86_64_GOTPCRELX;
+                } else if (match[1].str() == "rexgotpcrelx") {
+                    type = RelocationType::R_X86_64_REX_GOTPCRELX;
                 } else {
                     throw std::runtime_error("Invalid relocation type: " + match[1].str());
                 }
 
+                // 加数按 readelf 的十六进制输出解析；PC 相对类（.rel 与 GOT 类）的
+                // 加数与 FLE_ld 的公式（S + A - P - 8）配套，即 A = ELF 加数 + 8
+                int64_t addend = std::stoll(match[4].str(), nullptr, 16);
+                if (match[3].str() == "-") {
+                    addend = -addend;
+                }
+                if (is_pc_relative(type)) {
+                    addend += 8;
+                }
+
                 Relocation reloc {
                     type,
                     section.data.size(),
                     match[2].str(),
-                    std::stoi(match[3].str())
+                    addend
                 };
 
                 section.relocs.push_back(reloc);
@@ -163,7 +218,7 @@ FLEObject load_fle(const std::string& file)
             }
         }
 
-        if (key == ".bss") {
+        if (is_bss_section(key)) {
             section.bss_size = bss_size;
         } else {
             section.bss_size = 0;
@@ -175,6 +230,125 @@ FLEObject load_fle(const std::string& file)
     return obj;
 }
 
+FLEObject load_object(const std::string& filename)
+{
+    return is_elf_file(filename) ? load_elf(filename) : load_fle(filename);
+}
+
+LdCommand parse_ld_args(const std::vector<std::string>& args)
+{
+    LdCommand command;
+    bool reloc_cache = false;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "-o" && i + 1 < args.size()) {
+            command.outfile = args[++i];
+        } else if (args[i].starts_with("--format=")) {
+            command.format = args[i].substr(9);
+            if (command.format != "fle" && command.format != "elf") {
+                throw std::runtime_error("Unknown output format: " + command.format);
+            }
+        } else if (args[i].starts_with("--threads=")) {
+            command.options.threads = std::stoul(args[i].substr(10));
+        } else if (args[i] == "--discard-locals") {
+            command.options.discard_locals = true;
+        } else if (args[i] == "--pie") {
+            command.options.pie = true;
+        } else if (args[i] == "--hugepage-text") {
+            command.options.hugepage_text = true;
+        } else if (args[i].starts_with("--layout=")) {
+            command.options.layout = load_layout(args[i].substr(9));
+        } else if (args[i] == "--stream") {
+            command.stream = true;
+        } else if (args[i] == "--plan") {
+            command.plan = true;
+        } else if (args[i] == "--run") {
+            command.run = true;
+        } else if (args[i] == "--reloc-cache") {
+            reloc_cache = true;
+        } else if (args[i].starts_with("--reloc-cache=")) {
+            command.options.reloc_cache = args[i].substr(14);
+        } else {
+            command.inputs.push_back(args[i]);
+        }
+    }
+
+    if (command.inputs.empty()) {
+        throw std::runtime_error("No input files specified");
+    }
+    // 默认把链接计划缓存在输出文件旁边
+    if (reloc_cache && command.options.reloc_cache.empty()) {
+        command.options.reloc_cache = command.outfile + ".relocs";
+    }
+    // 流式链接边读边写，直接输出 ELF
+    if (command.stream && command.format != "elf") {
+        throw std::runtime_error("--stream requires --format=elf");
+    }
+    // ELF 输出按固定地址装载，没有地方放动态重定位表
+    if (command.options.pie && command.format != "fle") {
+        throw std::runtime_error("--pie requires --format=fle");
+    }
+    if (command.run && (command.stream || command.plan || command.format != "fle")) {
+        throw std::runtime_error("--run cannot be combined with --stream, --plan or --format=elf");
+    }
+    return command;
+}
+
+void run_ld(const LdCommand& command, const ObjectLoader& load)
+{
+    if (command.plan) {
+        FLE_ld_plan(command.inputs, load, command.options);
+        return;
+    }
+    if (command.stream) {
+        FLE_ld_stream(command.inputs, command.outfile, command.options);
+        return;
+    }
+
+    // 直接运行时标准输出留给程序，链接过程的日志改写到 stderr
+    auto* saved_out = std::cout.rdbuf();
+    if (command.run) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    std::vector<std::shared_ptr<const FLEObject>> objects;
+    for (const auto& file : command.inputs) {
+        objects.push_back(load(file));
+    }
+
+    std::vector<const FLEObject*> inputs;
+    for (const auto& obj : objects) {
+        inputs.push_back(obj.get());
+        std::cerr << "Object type: " << obj->type << std::endl;
+        std::cerr << "Symbols:" << std::endl;
+        for (const auto& sym : obj->symbols) {
+            std::cerr << "  " << sym.name << " in " << sym.section << std::endl;
+        }
+    }
+
+    // 链接
+    FLEObject linked_obj = FLE_ld(inputs, command.options);
+
+    if (command.run) {
+        // 链接结果已经是内存中的 FLEObject，省掉写 JSON 再解析的往返
+        std::cout.rdbuf(saved_out);
+        std::cout.flush();
+        std::cerr.flush();
+        inputs.clear();
+        objects.clear();
+        FLE_exec(linked_obj);
+    }
+
+    // 写入文件
+    if (command.format == "elf") {
+        FLE_write_elf(linked_obj, command.outfile);
+    } else {
+        FLEWriter writer;
+        FLE_objdump(linked_obj, writer);
+        writer.write_to_file(command.outfile);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     if (argc < 2) {
@@ -182,8 +356,23 @@ int main(int argc, char* argv[])
                   << "Commands:\n"
                   << "  objdump <input.fle>              Display contents of FLE file\n"
                   << "  nm <input.fle>                   Display symbol table\n"
-                  << "  ld [-o output.fle] input1.fle... Link FLE files\n"
-                  << "  exec <input.fle>                 Execute FLE file\n"
+                  << "  ld [-o output.fle] [--format=fle|elf] [--threads=N] [--reloc-cache[=FILE]]\n"
+                  << "     [--stream] [--hugepage-text] [--discard-locals] [--pie] [--layout=FILE] [--plan]\n"
+                  << "     [--run]\n"
+                  << "     input1.fle|input1.o...\n"
+                  << "                                   Link FLE files and ELF objects\n"
+                  << "  ld --stream --format=elf ...     Link with bounded memory: ELF inputs are read one\n"
+                  << "                                   section at a time, FLE inputs (JSON) one whole file\n"
+                  << "  ld --server=SOCKET               Run a resident linker with a warm object cache\n"
+                  << "  ld --connect=SOCKET [ld args...] Link through a running linker server\n"
+                  << "  exec [--loader-stats] [--relocate] [--fork-server[=SOCKET]] [--profile[=FILE]]\n"
+                  << "       [--perf-counters[=FILE]] [--syscall-stats] <input.fle|input.elf>\n"
+                  << "                                   Execute FLE file or ELF executable\n"
+                  << "  exec --batch[=THREADS] <input.fle>...\n"
+                  << "                                   Run --pie programs concurrently in one process\n"
+                  << "  exec --snapshot=FILE <input.fle>  Save the loaded, relocated image for instant startup\n"
+                  << "  exec --from-snapshot <snapshot>  Run a saved image\n"
+                  << "  exec --connect=SOCKET [--shutdown] Run once through a fork server, stdin as input\n"
                   << "  cc [-o output.fle] input.c...    Compile C files\n";
         return 1;
     }
@@ -205,46 +394,120 @@ int main(int argc, char* argv[])
             }
             FLE_nm(load_fle(args[0]));
         } else if (tool == "FLE_exec") {
-            if (args.size() != 1) {
-                throw std::runtime_error("Usage: exec <input.fle>");
+            const std::string usage = "Usage: exec [--loader-stats] [--relocate] [--fork-server[=SOCKET]] [--profile[=FILE]]\n"
+                                      "            [--perf-counters[=FILE]] [--syscall-stats] <input.fle|input.elf>\n"
+                                      "       exec --batch[=THREADS] [--loader-stats] [--relocate] <input.fle>...\n"
+                                      "       exec --snapshot=FILE [--loader-stats] [--relocate] <input.fle>\n"
+                                      "       exec --from-snapshot [--loader-stats] [--perf-counters[=FILE]] [--syscall-stats] <snapshot>\n"
+                                      "       exec --connect=SOCKET [--shutdown]";
+            if (!args.empty() && args[0].starts_with("--connect=")) {
+                if (args.size() > 2 || (args.size() == 2 && args[1] != "--shutdown")) {
+                    throw std::runtime_error(usage);
+                }
+                return FLE_exec_connect(args[0].substr(10), args.size() == 2);
             }
-            FLE_exec(load_fle(args[0]));
-        } else if (tool == "FLE_ld") {
-            std::string outfile = "a.out";
-            std::vector<std::string> input_files;
-
-            for (size_t i = 0; i < args.size(); ++i) {
-                if (args[i] == "-o" && i + 1 < args.size()) {
-                    outfile = args[++i];
+            ExecOptions options;
+            std::optional<std::string> fork_server;
+            std::optional<unsigned> batch;
+            std::optional<std::string> snapshot;
+            bool from_snapshot = false;
+            std::vector<std::string> files;
+            for (const auto& arg : args) {
+                if (arg == "--loader-stats") {
+                    options.loader_stats = true;
+                } else if (arg == "--relocate") {
+                    options.relocate = true;
+                } else if (arg == "--fork-server") {
+                    fork_server = "";
+                } else if (arg.starts_with("--fork-server=")) {
+                    fork_server = arg.substr(14);
+                } else if (arg.starts_with("--snapshot=")) {
+                    snapshot = arg.substr(11);
+                } else if (arg == "--from-snapshot") {
+                    from_snapshot = true;
+                } else if (arg == "--batch") {
+                    batch = 0;
+                } else if (arg.starts_with("--batch=")) {
+                    batch = std::stoul(arg.substr(8));
+                } else if (arg == "--profile") {
+                    options.profile = "";
+                } else if (arg.starts_with("--profile=")) {
+                    options.profile = arg.substr(10);
+                } else if (arg == "--perf-counters") {
+                    options.perf_counters = "";
+                } else if (arg.starts_with("--perf-counters=")) {
+                    options.perf_counters = arg.substr(16);
+                } else if (arg == "--syscall-stats") {
+                    options.syscall_stats = true;
+                } else if (!arg.starts_with("--")) {
+                    files.push_back(arg);
                 } else {
-                    input_files.push_back(args[i]);
+                    throw std::runtime_error(usage);
                 }
             }
-
-            if (input_files.empty()) {
-                throw std::runtime_error("No input files specified");
+            // 只有 --batch 接受多个程序
+            if (files.empty() || (!batch && files.size() > 1)) {
+                throw std::runtime_error(usage);
             }
-
-            std::vector<FLEObject> objects;
-            for (const auto& file : input_files) {
-                objects.push_back(load_fle(file));
+            const std::string& file = files.front();
+            // 这几种模式各自派生并监督子进程（或线程），一次只能用一种
+            const int modes = fork_server.has_value() + batch.has_value() + options.profile.has_value()
+                + options.perf_counters.has_value() + options.syscall_stats;
+            if (modes > 1) {
+                throw std::runtime_error("--fork-server, --batch, --profile, --perf-counters and --syscall-stats are exclusive");
             }
-
-            for (const auto& obj : objects) {
-                std::cerr << "Object type: " << obj.type << std::endl;
-                std::cerr << "Symbols:" << std::endl;
-                for (const auto& sym : obj.symbols) {
-                    std::cerr << "  " << sym.name << " in " << sym.section << std::endl;
+            // 符号化用的是链接时的地址
+            if (options.relocate && (options.profile || options.syscall_stats)) {
+                throw std::runtime_error("--relocate cannot be combined with --profile or --syscall-stats");
+            }
+            if (options.relocate && is_elf_file(file)) {
+                throw std::runtime_error("--relocate needs an FLE executable linked with --pie");
+            }
+            if (options.profile) {
+                if (is_elf_file(file)) {
+                    throw std::runtime_error("--profile needs an FLE executable");
+                }
+                if (options.profile->empty()) {
+                    options.profile = file + ".folded";
                 }
             }
-
-            // 链接
-            FLEObject linked_obj = FLE_ld(objects);
-
-            // 写入文件
-            FLEWriter writer;
-            FLE_objdump(linked_obj, writer);
-            writer.write_to_file(outfile);
+            // 快照只保存映像、不运行；恢复的映像没有符号表，只能用不需要符号的监督模式
+            if (snapshot && (modes > 0 || from_snapshot)) {
+                throw std::runtime_error("--snapshot only combines with --loader-stats and --relocate");
+            }
+            if (from_snapshot && (fork_server || batch || options.profile || options.relocate)) {
+                throw std::runtime_error("--from-snapshot cannot be combined with --relocate, --fork-server, --batch or --profile");
+            }
+            if (snapshot) {
+                if (is_elf_file(file)) {
+                    throw std::runtime_error("--snapshot needs an FLE executable");
+                }
+                FLE_write_snapshot(file, *snapshot, options);
+                return 0;
+            }
+            if (from_snapshot) {
+                FLE_exec_snapshot(file, options);
+                return 0;
+            }
+            if (batch) {
+                return FLE_exec_batch(files, *batch, options);
+            }
+            if (fork_server) {
+                return FLE_exec_server(file, *fork_server, options);
+            }
+            if (is_elf_file(file)) {
+                FLE_exec_elf(file, options);
+            } else {
+                FLE_exec(load_fle(file), options);
+            }
+        } else if (tool == "FLE_ld") {
+            if (!args.empty() && args[0].starts_with("--server=")) {
+                return FLE_ld_server(args[0].substr(9));
+            }
+            if (!args.empty() && args[0].starts_with("--connect=")) {
+                return FLE_ld_connect(args[0].substr(10), { args.begin() + 1, args.end() });
+            }
+            run_ld(parse_ld_args(args), [](const std::string& file) { return std::make_shared<const FLEObject>(load_object(file)); });
         } else if (tool == "FLE_cc") {
             FLE_cc(args);
         } else if (tool == "FLE_readfle") {
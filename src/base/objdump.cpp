@@ -11,16 +11,29 @@ void FLE_objdump(const FLEObject& obj, FLEWriter& writer)
     if (obj.type == ".exe") {
         writer.write_program_headers(obj.phdrs);
         writer.write_entry(obj.entry);
+        if (!obj.build_id.empty()) {
+            writer.write_build_id(obj.build_id);
+        }
+        if (obj.dynamic_relocs) {
+            writer.write_dynamic_relocs(*obj.dynamic_relocs);
+        }
+        writer.write_symbols(obj.symbols);
+        writer.write_symbol_index(obj.symbol_index);
+    }
+
+    if (!obj.groups.empty()) {
+        writer.write_groups(obj.groups);
     }
 
     // 写入所有段的内容
     for (const auto& [name, section] : obj.sections) {
         writer.begin_section(name);
 
-        // 收集所有断点（符号和重定位的位置）
+        // 收集所有断点（符号和重定位的位置），.exe 的符号单独存放
+        const bool inline_symbols = obj.type != ".exe";
         std::vector<size_t> breaks;
         for (const auto& sym : obj.symbols) {
-            if (sym.section == name) { // only collect symbols for current section
+            if (inline_symbols && sym.section == name) { // only collect symbols for current section
                 breaks.push_back(sym.offset);
             }
         }
@@ -34,7 +47,7 @@ void FLE_objdump(const FLEObject& obj, FLEWriter& writer)
         while (pos < section.data.size()) {
             // 1. 检查当前位置是否有符号或重定位
             for (const auto& sym : obj.symbols) {
-                if (sym.section == name && sym.offset == pos) {
+                if (inline_symbols && sym.section == name && sym.offset == pos) {
                     std::string line;
                     switch (sym.type) {
                     case SymbolType::LOCAL:
@@ -62,6 +75,12 @@ void FLE_objdump(const FLEObject& obj, FLEWriter& writer)
                         reloc_format = ".abs64";
                     } else if (reloc.type == RelocationType::R_X86_64_32S) {
                         reloc_format = ".abs32s";
+                    } else if (reloc.type == RelocationType::R_X86_64_GOTPCREL) {
+                        reloc_format = ".gotpcrel";
+                    } else if (reloc.type == RelocationType::R_X86_64_GOTPCRELX) {
+                        reloc_format = ".gotpcrelx";
+                    } else if (reloc.type == RelocationType::R_X86_64_REX_GOTPCRELX) {
+                        reloc_format = ".rexgotpcrelx";
                     }
 
                     std::stringstream ss;
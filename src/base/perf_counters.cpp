@@ -0,0 +1,191 @@
+#include "fle.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// 性能计数器：子进程映射好映像后停下来等待，父进程在它身上打开 perf_event 计数器并启用，
+// 再放行子进程跳到入口。程序以 exit 系统调用结束，计数器的描述符在父进程手里，
+// 子进程退出后仍能读出最终值。
+// 没有硬件 PMU（虚拟机、容器）时 cycles/instructions 报告为 null，其余软件事件照常；
+// 连 perf_event_open 都不可用时退回 wait4 得到的 rusage（包含加载器自身的开销）。
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct CounterSpec {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+const CounterSpec COUNTERS[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+std::runtime_error system_error(const std::string& what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+int open_counter(const CounterSpec& spec, pid_t pid)
+{
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.disabled = 1;
+    // 只数用户态，perf_event_paranoid = 2 时非特权用户也能打开
+    attr.exclude_kernel = spec.type == PERF_TYPE_HARDWARE;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+// 计数器被复用（多路轮转）时按实际运行时间的比例放大
+std::optional<uint64_t> read_counter(int fd)
+{
+    uint64_t values[3];
+    if (fd < 0 || ::read(fd, values, sizeof(values)) != sizeof(values)) {
+        return std::nullopt;
+    }
+    const auto [value, enabled, running] = values;
+    if (running == 0) {
+        return enabled == 0 ? std::optional<uint64_t>(0) : std::nullopt;
+    }
+    return running < enabled ? static_cast<uint64_t>(static_cast<double>(value) * enabled / running) : value;
+}
+
+void wait_byte(int fd)
+{
+    char byte;
+    while (::read(fd, &byte, 1) < 0 && errno == EINTR) {
+    }
+}
+
+} // anonymous namespace
+
+int FLE_perf_counters(const std::string& program, const std::string& output, const std::function<uint64_t()>& load)
+{
+    int ready[2], go[2];
+    if (::pipe2(ready, O_CLOEXEC) < 0 || ::pipe2(go, O_CLOEXEC) < 0) {
+        throw system_error("pipe");
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        throw system_error("fork");
+    }
+    if (pid == 0) {
+        ::close(ready[0]);
+        ::close(go[1]);
+        try {
+            const uint64_t entry = load();
+            // 告诉父进程映像已就绪，等它把计数器打开
+            ::write(ready[1], "r", 1);
+            wait_byte(go[0]);
+            using FuncType = int (*)();
+            reinterpret_cast<FuncType>(entry)();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+        ::_exit(127);
+    }
+    ::close(ready[1]);
+    ::close(go[0]);
+
+    // 加载失败时子进程直接退出，读端收到 EOF，不必打开计数器
+    char byte;
+    const bool loaded = ::read(ready[0], &byte, 1) == 1;
+    ::close(ready[0]);
+
+    std::vector<int> fds;
+    bool any_open = false, hardware = false;
+    if (loaded) {
+        for (const auto& spec : COUNTERS) {
+            fds.push_back(open_counter(spec, pid));
+            any_open |= fds.back() >= 0;
+            hardware |= fds.back() >= 0 && spec.type == PERF_TYPE_HARDWARE;
+        }
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+    const auto start = Clock::now();
+    if (loaded) {
+        ::write(go[1], "g", 1);
+    }
+    ::close(go[1]);
+
+    int status;
+    rusage usage {};
+    while (::wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            throw system_error("wait4");
+        }
+    }
+    const auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    const int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    json report;
+    report["program"] = program;
+    report["exit_code"] = exit_code;
+    report["wall_time_ns"] = wall_ns;
+    report["source"] = any_open ? "perf_event" : "rusage";
+    report["hardware"] = hardware;
+    json counters = json::object();
+    if (any_open) {
+        for (size_t i = 0; i != fds.size(); ++i) {
+            const auto value = read_counter(fds[i]);
+            counters[COUNTERS[i].name] = value ? json(*value) : json(nullptr);
+            if (fds[i] >= 0) {
+                ::close(fds[i]);
+            }
+        }
+    } else {
+        auto ns = [](const timeval& tv) { return static_cast<uint64_t>(tv.tv_sec) * 1000000000 + tv.tv_usec * 1000; };
+        counters["cycles"] = nullptr;
+        counters["instructions"] = nullptr;
+        counters["task_clock_ns"] = ns(usage.ru_utime) + ns(usage.ru_stime);
+        counters["page_faults"] = usage.ru_minflt + usage.ru_majflt;
+        counters["context_switches"] = usage.ru_nvcsw + usage.ru_nivcsw;
+    }
+    report["counters"] = counters;
+    if (counters["cycles"].is_number() && counters["instructions"].is_number() && counters["cycles"] != 0) {
+        report["ipc"] = counters["instructions"].get<double>() / counters["cycles"].get<double>();
+    } else {
+        report["ipc"] = nullptr;
+    }
+
+    const std::string text = report.dump(2) + "\n";
+    if (output.empty()) {
+        std::cerr << text << std::flush;
+    } else {
+        std::ofstream out(output);
+        if (!out) {
+            throw std::runtime_error("Cannot write performance counters: " + output);
+        }
+        out << text;
+    }
+    return exit_code;
+}
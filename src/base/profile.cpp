@@ -0,0 +1,311 @@
+#include "fle.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <pthread.h>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <vector>
+
+// 采样分析器：子进程映射并运行程序，ITIMER_PROF 每消耗一段 CPU 时间触发一次 SIGPROF，
+// 信号处理函数把 RIP 与帧指针链写进父子进程共享的环形缓冲区。
+// 程序以 exit 系统调用直接结束，没有机会在进程内汇总，所以由父进程边等边取样本，
+// 子进程退出后再按 FLE 符号表归并成平面报告与折叠栈。
+
+namespace {
+
+constexpr long SAMPLE_PERIOD_US = 1000;
+constexpr size_t MAX_DEPTH = 32;
+constexpr size_t RING_CAPACITY = 8192;
+
+struct Sample {
+    uint32_t depth;
+    uint64_t pcs[MAX_DEPTH]; // pcs[0] 是被打断的指令，其后是逐层的返回地址
+};
+
+// 单生产者（子进程的信号处理函数）、单消费者（父进程）的无锁环，按 seqlock 的方式同步：
+// 生产者写完槽位再以 release 发布 head；消费者复制槽位后经 acquire 栅栏重读 head，
+// 期间被追上的样本作废。槽位字段用 relaxed 原子访问，并发的读写不构成数据竞争
+struct SampleRing {
+    std::atomic<uint64_t> head;
+    Sample slots[RING_CAPACITY];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic_ref<uint64_t>::is_always_lock_free && std::atomic_ref<uint32_t>::is_always_lock_free);
+
+template <typename T>
+void store_field(T& field, T value)
+{
+    std::atomic_ref<T>(field).store(value, std::memory_order_relaxed);
+}
+
+template <typename T>
+T load_field(T& field)
+{
+    return std::atomic_ref<T>(field).load(std::memory_order_relaxed);
+}
+
+// 信号处理函数只能访问全局状态
+SampleRing* sample_ring;
+uint64_t image_start, image_end;
+uint64_t stack_end;
+
+void on_sigprof(int, siginfo_t*, void* context)
+{
+    const auto& regs = static_cast<ucontext_t*>(context)->uc_mcontext.gregs;
+    const uint64_t head = sample_ring->head.load(std::memory_order_relaxed);
+    Sample& sample = sample_ring->slots[head % RING_CAPACITY];
+    // 上一次发布的 head 必须先于本次对槽位的写入可见，消费者才能据此识别被覆盖的槽位
+    std::atomic_thread_fence(std::memory_order_release);
+
+    store_field<uint64_t>(sample.pcs[0], regs[REG_RIP]);
+    uint32_t depth = 1;
+    // 沿帧指针回溯：帧必须在栈内且逐层升高，返回地址必须落在映像里，
+    // 否则说明这段代码没有保留帧指针，到此为止。
+    // 省略了帧指针的叶函数（gcc 默认 -momit-leaf-frame-pointer）会漏掉它的直接调用者
+    uint64_t fp = regs[REG_RBP];
+    uint64_t low = regs[REG_RSP];
+    while (depth < MAX_DEPTH && fp >= low && fp % 8 == 0 && fp + 16 <= stack_end) {
+        const auto* frame = reinterpret_cast<const uint64_t*>(fp);
+        if (frame[1] < image_start || frame[1] >= image_end) {
+            break;
+        }
+        store_field(sample.pcs[depth++], frame[1]);
+        low = fp + 16;
+        fp = frame[0];
+    }
+    store_field(sample.depth, depth);
+    sample_ring->head.store(head + 1, std::memory_order_release);
+}
+
+[[noreturn]] void run_child(const FLEObject& exe, const std::function<uint64_t()>& load)
+{
+    try {
+        const uint64_t entry = load();
+
+        image_start = UINT64_MAX;
+        image_end = 0;
+        for (const auto& phdr : exe.phdrs) {
+            image_start = std::min(image_start, phdr.vaddr);
+            image_end = std::max(image_end, phdr.vaddr + phdr.size);
+        }
+        pthread_attr_t attr;
+        void* stack_addr;
+        size_t stack_size;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0 || pthread_attr_getstack(&attr, &stack_addr, &stack_size) != 0) {
+            throw std::runtime_error("Cannot determine the stack range");
+        }
+        pthread_attr_destroy(&attr);
+        stack_end = reinterpret_cast<uint64_t>(stack_addr) + stack_size;
+
+        struct sigaction action {};
+        action.sa_sigaction = on_sigprof;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) < 0) {
+            throw std::runtime_error(std::string("sigaction: ") + strerror(errno));
+        }
+        const itimerval timer { { 0, SAMPLE_PERIOD_US }, { 0, SAMPLE_PERIOD_US } };
+        if (setitimer(ITIMER_PROF, &timer, nullptr) < 0) {
+            throw std::runtime_error(std::string("setitimer: ") + strerror(errno));
+        }
+
+        using FuncType = int (*)();
+        reinterpret_cast<FuncType>(entry)();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+    _exit(127);
+}
+
+// 父进程一侧：逐个取出新样本，同一条栈只保存一份计数
+class SampleCollector {
+public:
+    explicit SampleCollector(SampleRing& ring)
+        : ring(ring)
+    {
+    }
+
+    void drain()
+    {
+        const uint64_t head = ring.head.load(std::memory_order_acquire);
+        if (head - tail > RING_CAPACITY) {
+            dropped += head - tail - RING_CAPACITY;
+            tail = head - RING_CAPACITY;
+        }
+        for (; tail != head; ++tail) {
+            Sample& slot = ring.slots[tail % RING_CAPACITY];
+            const uint32_t depth = std::min<uint32_t>(load_field(slot.depth), MAX_DEPTH);
+            std::vector<uint64_t> pcs(depth);
+            for (uint32_t i = 0; i != depth; ++i) {
+                pcs[i] = load_field(slot.pcs[i]);
+            }
+            // 复制槽位的读取不能移到重读 head 之后；
+            // head 追上 tail + RING_CAPACITY 时信号处理函数正在写的就是这个槽位
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (ring.head.load(std::memory_order_relaxed) - tail >= RING_CAPACITY) {
+                ++dropped; // 复制期间槽位已被覆盖或正在被覆盖
+                continue;
+            }
+            ++stacks[std::move(pcs)];
+            ++total;
+        }
+    }
+
+    std::map<std::vector<uint64_t>, size_t> stacks;
+    size_t total = 0;
+    size_t dropped = 0;
+
+private:
+    SampleRing& ring;
+    uint64_t tail = 0;
+};
+
+// 可执行文件的段按输出节命名，用段来归属没有符号覆盖的地址
+std::string section_of(const FLEObject& exe, uint64_t addr)
+{
+    if (const Symbol* sym = find_symbol_by_address(exe, addr)) {
+        return sym->section;
+    }
+    for (const auto& phdr : exe.phdrs) {
+        if (addr >= phdr.vaddr && addr < phdr.vaddr + phdr.size) {
+            return phdr.name;
+        }
+    }
+    return "[unknown]";
+}
+
+// 返回地址指向 call 的下一条指令，减一后才一定落在调用者内部
+std::string frame_name(const FLEObject& exe, uint64_t pc, bool is_return_address)
+{
+    const uint64_t addr = is_return_address ? pc - 1 : pc;
+    if (const Symbol* sym = find_symbol_by_address(exe, addr)) {
+        return sym->name;
+    }
+    return "[" + section_of(exe, addr) + "]";
+}
+
+struct FlatEntry {
+    std::string name;
+    std::string section;
+    size_t self = 0;
+    size_t total = 0;
+};
+
+void report(const FLEObject& exe, const SampleCollector& samples, const std::string& folded_path)
+{
+    std::map<std::string, FlatEntry> flat;
+    std::map<std::string, size_t> sections;
+    std::map<std::string, size_t> folded;
+
+    for (const auto& [pcs, count] : samples.stacks) {
+        std::vector<std::string> names;
+        std::set<std::string> seen;
+        for (size_t i = 0; i != pcs.size(); ++i) {
+            names.push_back(frame_name(exe, pcs[i], i != 0));
+            auto& entry = flat[names.back()];
+            if (entry.name.empty()) {
+                entry.name = names.back();
+                entry.section = section_of(exe, i != 0 ? pcs[i] - 1 : pcs[i]);
+            }
+            // 递归调用在同一条栈里只算一次
+            if (seen.insert(names.back()).second) {
+                entry.total += count;
+            }
+        }
+        flat[names[0]].self += count;
+        sections[flat[names[0]].section] += count;
+
+        std::string line;
+        for (auto it = names.rbegin(); it != names.rend(); ++it) {
+            line += (line.empty() ? "" : ";") + *it;
+        }
+        folded[line] += count;
+    }
+
+    std::vector<FlatEntry> entries;
+    for (auto& [name, entry] : flat) {
+        entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const FlatEntry& a, const FlatEntry& b) {
+        return a.self != b.self ? a.self > b.self : a.total != b.total ? a.total > b.total : a.name < b.name;
+    });
+
+    const double scale = samples.total ? 100.0 / samples.total : 0;
+    std::fprintf(stderr, "\n=== Profile: %zu samples every %ld us, %zu dropped ===\n", samples.total, SAMPLE_PERIOD_US,
+        samples.dropped);
+    std::fprintf(stderr, "%8s %6s %8s %6s  %-24s %s\n", "Self", "%", "Total", "%", "Symbol", "Section");
+    for (const auto& entry : entries) {
+        std::fprintf(stderr, "%8zu %5.1f%% %8zu %5.1f%%  %-24s %s\n", entry.self, entry.self * scale, entry.total,
+            entry.total * scale, entry.name.c_str(), entry.section.c_str());
+    }
+    std::fprintf(stderr, "By section:\n");
+    for (const auto& [name, count] : sections) {
+        std::fprintf(stderr, "%8zu %5.1f%%  %s\n", count, count * scale, name.c_str());
+    }
+
+    std::ofstream out(folded_path);
+    if (!out) {
+        throw std::runtime_error("Cannot write folded stacks: " + folded_path);
+    }
+    for (const auto& [line, count] : folded) {
+        out << line << " " << count << "\n";
+    }
+    std::fprintf(stderr, "Folded stacks: %s (%zu stacks)\n", folded_path.c_str(), folded.size());
+}
+
+} // anonymous namespace
+
+int FLE_profile(const FLEObject& exe, const std::string& folded_path, const std::function<uint64_t()>& load)
+{
+    void* shared = mmap(nullptr, sizeof(SampleRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        throw std::runtime_error(std::string("mmap: ") + strerror(errno));
+    }
+    sample_ring = new (shared) SampleRing {};
+
+    std::cout.flush();
+    std::cerr.flush();
+    const pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error(std::string("fork: ") + strerror(errno));
+    }
+    if (pid == 0) {
+        run_child(exe, load);
+    }
+
+    // 每 10 ms 取一次样本，环的容量远大于这段时间内的样本数
+    SampleCollector samples(*sample_ring);
+    int status;
+    for (;;) {
+        samples.drain();
+        const pid_t done = waitpid(pid, &status, WNOHANG);
+        if (done == pid) {
+            break;
+        }
+        if (done < 0 && errno != EINTR) {
+            throw std::runtime_error(std::string("waitpid: ") + strerror(errno));
+        }
+        usleep(10000);
+    }
+    samples.drain();
+    munmap(shared, sizeof(SampleRing));
+
+    report(exe, samples, folded_path);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
@@ -0,0 +1,96 @@
+#include "socket_utils.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+std::runtime_error system_error(const std::string& what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+sockaddr_un socket_address(const std::string& path)
+{
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+void write_all(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        ssize_t n = ::write(fd, data.data(), data.size());
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw system_error("write");
+        }
+        data.remove_prefix(n);
+    }
+}
+
+std::string read_all(int fd)
+{
+    std::string data;
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw system_error("read");
+        }
+        if (n == 0)
+            return data;
+        data.append(buffer, n);
+    }
+}
+
+int listen_socket(const std::string& socket_path, int type_flags)
+{
+    // 临时路径比 socket_path 多 4 个字节，按它检查长度，报错时给出用户写的路径
+    const std::string bind_path = socket_path + ".tmp";
+    if (bind_path.size() >= sizeof(sockaddr_un::sun_path)) {
+        throw std::runtime_error("Socket path too long (at most " + std::to_string(sizeof(sockaddr_un::sun_path) - 5)
+            + " bytes): " + socket_path);
+    }
+    const auto addr = socket_address(bind_path);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | type_flags, 0);
+    if (listener < 0) {
+        throw system_error("socket");
+    }
+    ::unlink(bind_path.c_str());
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        const auto error = system_error("bind " + bind_path);
+        ::close(listener);
+        throw error;
+    }
+    if (::listen(listener, 16) < 0 || ::rename(bind_path.c_str(), socket_path.c_str()) < 0) {
+        const auto error = system_error("listen on " + socket_path);
+        ::close(listener);
+        ::unlink(bind_path.c_str());
+        throw error;
+    }
+    return listener;
+}
+
+int connect_socket(const std::string& socket_path, const std::string& server)
+{
+    const auto addr = socket_address(socket_path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw system_error("socket");
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        const auto error = system_error("Cannot connect to " + server + " " + socket_path);
+        ::close(fd);
+        throw error;
+    }
+    return fd;
+}
@@ -0,0 +1,286 @@
+#include "fle.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// 系统调用统计（相当于 strace -c）：子进程映射好映像后 PTRACE_TRACEME 并停下，
+// 父进程用 PTRACE_SYSCALL 逐个拦截进入/退出，按调用号累计次数与耗时。
+// 调用点通过扫描用户栈得到：栈上的某个字若是返回地址，它前面应是一条
+// 直接 call 指令，且目标正是当前所在函数的起点；这样逐层向上认出调用链。
+// 尾调用（jmp）和间接调用不留下这样的痕迹，调用链在那里截止。
+// 只有 FLE 可执行文件带符号，ELF 可执行文件只报告计数与耗时。
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t STACK_SCAN_BYTES = 8192; // printf 在栈上有 1 KiB 的缓冲区
+constexpr size_t MAX_CALLERS = 3;
+constexpr size_t TOP_SITES = 10;
+
+#define SYSCALL_NAME(name) { SYS_##name, #name }
+const std::map<uint64_t, const char*> SYSCALL_NAMES = {
+    SYSCALL_NAME(read), SYSCALL_NAME(write), SYSCALL_NAME(open), SYSCALL_NAME(close), SYSCALL_NAME(stat),
+    SYSCALL_NAME(fstat), SYSCALL_NAME(lseek), SYSCALL_NAME(mmap), SYSCALL_NAME(mprotect), SYSCALL_NAME(munmap),
+    SYSCALL_NAME(brk), SYSCALL_NAME(rt_sigaction), SYSCALL_NAME(rt_sigprocmask), SYSCALL_NAME(ioctl),
+    SYSCALL_NAME(pread64), SYSCALL_NAME(pwrite64), SYSCALL_NAME(readv), SYSCALL_NAME(writev), SYSCALL_NAME(access),
+    SYSCALL_NAME(pipe), SYSCALL_NAME(sched_yield), SYSCALL_NAME(madvise), SYSCALL_NAME(dup), SYSCALL_NAME(dup2),
+    SYSCALL_NAME(nanosleep), SYSCALL_NAME(getpid), SYSCALL_NAME(socket), SYSCALL_NAME(connect),
+    SYSCALL_NAME(clone), SYSCALL_NAME(fork), SYSCALL_NAME(execve), SYSCALL_NAME(exit), SYSCALL_NAME(wait4),
+    SYSCALL_NAME(kill), SYSCALL_NAME(uname), SYSCALL_NAME(fcntl), SYSCALL_NAME(getcwd), SYSCALL_NAME(unlink),
+    SYSCALL_NAME(gettimeofday), SYSCALL_NAME(getuid), SYSCALL_NAME(gettid), SYSCALL_NAME(time),
+    SYSCALL_NAME(futex), SYSCALL_NAME(clock_gettime), SYSCALL_NAME(clock_nanosleep), SYSCALL_NAME(exit_group),
+    SYSCALL_NAME(openat), SYSCALL_NAME(newfstatat), SYSCALL_NAME(getrandom),
+};
+#undef SYSCALL_NAME
+
+std::string syscall_name(uint64_t nr)
+{
+    auto it = SYSCALL_NAMES.find(nr);
+    return it != SYSCALL_NAMES.end() ? it->second : "syscall_" + std::to_string(nr);
+}
+
+std::runtime_error system_error(const std::string& what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// 用可执行文件自己的节内容回答“这个地址上的代码是什么”，不必读被跟踪进程的内存
+class CodeImage {
+public:
+    explicit CodeImage(const FLEObject& exe)
+        : exe(exe)
+    {
+    }
+
+    bool is_code(uint64_t addr) const { return segment(addr) != nullptr; }
+
+    // addr 前面是否为一条直接调用 target 的 call rel32 指令
+    bool is_call_to(uint64_t return_addr, uint64_t target) const
+    {
+        const auto* bytes = code(return_addr - 5, 5);
+        if (!bytes || bytes[0] != 0xe8) {
+            return false;
+        }
+        int32_t rel;
+        std::memcpy(&rel, bytes + 1, sizeof(rel));
+        return return_addr + static_cast<int64_t>(rel) == target;
+    }
+
+    // 包含 addr 的函数的起点，找不到返回 0
+    uint64_t function_start(uint64_t addr) const
+    {
+        const Symbol* sym = find_symbol_by_address(exe, addr);
+        return sym ? sym->offset : 0;
+    }
+
+    std::string describe(uint64_t addr) const
+    {
+        char text[32];
+        if (const Symbol* sym = find_symbol_by_address(exe, addr)) {
+            std::snprintf(text, sizeof(text), "+0x%lx", static_cast<unsigned long>(addr - sym->offset));
+            return sym->name + text;
+        }
+        std::snprintf(text, sizeof(text), "0x%lx", static_cast<unsigned long>(addr));
+        return text;
+    }
+
+private:
+    const ProgramHeader* segment(uint64_t addr) const
+    {
+        for (const auto& phdr : exe.phdrs) {
+            if ((phdr.flags & static_cast<uint32_t>(PHF::X)) && addr >= phdr.vaddr && addr < phdr.vaddr + phdr.size) {
+                return &phdr;
+            }
+        }
+        return nullptr;
+    }
+
+    const uint8_t* code(uint64_t addr, size_t size) const
+    {
+        const ProgramHeader* phdr = segment(addr);
+        if (!phdr || addr + size > phdr->vaddr + phdr->size) {
+            return nullptr;
+        }
+        auto it = exe.sections.find(phdr->name);
+        if (it == exe.sections.end() || addr - phdr->vaddr + size > it->second.data.size()) {
+            return nullptr;
+        }
+        return it->second.data.data() + (addr - phdr->vaddr);
+    }
+
+    const FLEObject& exe;
+};
+
+// 调用点：发起系统调用的指令地址，加上逐层的返回地址
+std::vector<uint64_t> call_site(pid_t pid, const CodeImage& image, uint64_t ip, uint64_t sp)
+{
+    std::vector<uint64_t> site { ip };
+    uint64_t target = image.function_start(ip - 1);
+    if (target == 0) {
+        return site;
+    }
+
+    uint64_t stack[STACK_SCAN_BYTES / 8];
+    iovec local { stack, sizeof(stack) };
+    iovec remote { reinterpret_cast<void*>(sp), sizeof(stack) };
+    const ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    for (ssize_t i = 0; i < n / 8 && site.size() <= MAX_CALLERS; ++i) {
+        const uint64_t word = stack[i];
+        if (image.is_code(word) && image.is_call_to(word, target)) {
+            site.push_back(word);
+            target = image.function_start(word - 1);
+            if (target == 0) {
+                break;
+            }
+        }
+    }
+    return site;
+}
+
+struct Totals {
+    size_t calls = 0;
+    size_t errors = 0;
+    double seconds = 0;
+};
+
+void report(const std::map<uint64_t, Totals>& by_syscall,
+    const std::map<std::pair<uint64_t, std::vector<uint64_t>>, Totals>& by_site, const CodeImage& image)
+{
+    size_t calls = 0;
+    double seconds = 0;
+    for (const auto& [nr, totals] : by_syscall) {
+        calls += totals.calls;
+        seconds += totals.seconds;
+    }
+
+    std::vector<std::pair<uint64_t, Totals>> rows(by_syscall.begin(), by_syscall.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.seconds != b.second.seconds ? a.second.seconds > b.second.seconds : a.first < b.first;
+    });
+    std::fprintf(stderr, "\n=== Syscall stats: %zu calls, %.6f s in syscalls ===\n", calls, seconds);
+    std::fprintf(stderr, "%7s %11s %11s %9s %9s  %s\n", "% time", "seconds", "usecs/call", "calls", "errors", "syscall");
+    for (const auto& [nr, totals] : rows) {
+        std::fprintf(stderr, "%7.2f %11.6f %11.0f %9zu %9zu  %s\n", seconds > 0 ? 100 * totals.seconds / seconds : 0.0,
+            totals.seconds, totals.calls ? 1e6 * totals.seconds / totals.calls : 0.0, totals.calls, totals.errors,
+            syscall_name(nr).c_str());
+    }
+
+    std::vector<std::pair<std::pair<uint64_t, std::vector<uint64_t>>, Totals>> sites(by_site.begin(), by_site.end());
+    std::sort(sites.begin(), sites.end(), [](const auto& a, const auto& b) {
+        return a.second.calls != b.second.calls ? a.second.calls > b.second.calls : a.first < b.first;
+    });
+    std::fprintf(stderr, "Hottest call sites:\n");
+    std::fprintf(stderr, "%9s %11s  %-12s %s\n", "calls", "usecs", "syscall", "site");
+    for (size_t i = 0; i != sites.size() && i != TOP_SITES; ++i) {
+        const auto& [key, totals] = sites[i];
+        std::string chain;
+        for (uint64_t addr : key.second) {
+            // 第一项是 syscall 指令之后的地址，其余是返回地址，都减一落回调用指令内
+            chain += (chain.empty() ? "" : " <- ") + image.describe(addr - 1);
+        }
+        std::fprintf(stderr, "%9zu %11.0f  %-12s %s\n", totals.calls, 1e6 * totals.seconds, syscall_name(key.first).c_str(),
+            chain.c_str());
+    }
+}
+
+} // anonymous namespace
+
+int FLE_syscall_stats(const FLEObject& exe, const std::function<uint64_t()>& load)
+{
+    std::cout.flush();
+    std::cerr.flush();
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        throw system_error("fork");
+    }
+    if (pid == 0) {
+        try {
+            const uint64_t entry = load();
+            if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0) {
+                throw system_error("ptrace");
+            }
+            // 停下来等父进程设好选项；kill 是一次直接的系统调用，放行后立即跳到入口
+            ::kill(::getpid(), SIGSTOP);
+            using FuncType = int (*)();
+            reinterpret_cast<FuncType>(entry)();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+        ::_exit(127);
+    }
+
+    int status;
+    if (::waitpid(pid, &status, 0) < 0) {
+        throw system_error("waitpid");
+    }
+    if (!WIFSTOPPED(status)) {
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL) < 0) {
+        throw system_error("ptrace(PTRACE_SETOPTIONS)");
+    }
+
+    const CodeImage image(exe);
+    std::map<uint64_t, Totals> by_syscall;
+    std::map<std::pair<uint64_t, std::vector<uint64_t>>, Totals> by_site;
+    Totals* current_syscall = nullptr;
+    Totals* current_site = nullptr;
+    Clock::time_point entered;
+    int pending_signal = 0;
+
+    for (;;) {
+        if (ptrace(PTRACE_SYSCALL, pid, nullptr, pending_signal) < 0) {
+            throw system_error("ptrace(PTRACE_SYSCALL)");
+        }
+        pending_signal = 0;
+        if (::waitpid(pid, &status, 0) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw system_error("waitpid");
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            break;
+        }
+        if (WSTOPSIG(status) != (SIGTRAP | 0x80)) {
+            // 信号递送停止：把信号原样交给程序
+            pending_signal = WSTOPSIG(status);
+            continue;
+        }
+
+        __ptrace_syscall_info info {};
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) < 0) {
+            throw system_error("ptrace(PTRACE_GET_SYSCALL_INFO)");
+        }
+        if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+            current_syscall = &by_syscall[info.entry.nr];
+            current_site = &by_site[{ info.entry.nr, call_site(pid, image, info.instruction_pointer, info.stack_pointer) }];
+            ++current_syscall->calls;
+            ++current_site->calls;
+            entered = Clock::now();
+        } else if (info.op == PTRACE_SYSCALL_INFO_EXIT && current_syscall) {
+            const double seconds = std::chrono::duration<double>(Clock::now() - entered).count();
+            for (Totals* totals : { current_syscall, current_site }) {
+                totals->seconds += seconds;
+                totals->errors += info.exit.is_error ? 1 : 0;
+            }
+            current_syscall = current_site = nullptr;
+        }
+    }
+
+    report(by_syscall, by_site, image);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
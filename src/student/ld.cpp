@@ -1,263 +1,2083 @@
 #include "fle.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <concepts>
+#include <cstring>
+#include <deque>
+#include <fnmatch.h>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <span>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
-FLEObject FLE_ld(const std::vector<FLEObject>& objects)
+namespace {
+
+constexpr uint64_t BASE_VADDR = 0x400000;
+constexpr uint64_t PAGE_SIZE = 0x1000;
+constexpr uint64_t HUGE_PAGE_SIZE = 0x200000;
+
+// 远跳板：jmp *0(%rip)，紧跟 8 字节绝对目标地址，补齐到 16 字节
+const std::string THUNK_SECTION = ".thunks";
+constexpr size_t THUNK_SIZE = 16;
+
+// 链接器合成的 GOT，每项 8 字节绝对地址
+const std::string GOT_SECTION = ".got";
+constexpr size_t GOT_ENTRY_SIZE = 8;
+
+bool section_in(std::string_view name, std::string_view prefix)
+{
+    return name == prefix || (name.starts_with(prefix) && name[prefix.size()] == '.');
+}
+
+bool is_text_section(std::string_view name)
+{
+    return section_in(name, ".text") || section_in(name, ".ltext") || name == THUNK_SECTION;
+}
+
+// -mcmodel=medium/large 的大节，布局在所有常规节之后，不占用 32 位地址窗口
+bool is_large_section(std::string_view name)
+{
+    return section_in(name, ".ldata") || section_in(name, ".lrodata")
+        || section_in(name, ".lbss") || section_in(name, ".ltext");
+}
+
+bool fits_int32(int64_t value)
+{
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// 重定位位置前的两个字节（不足时补 0），足以识别跳转与 GOT 访问指令
+using Site = std::array<uint8_t, 2>;
+
+// 重定位位置前是否为 call/jmp/jcc rel32，只有这些指令可以改走跳板
+bool is_branch_site(const Site& site)
+{
+    if (site[1] == 0xe8 || site[1] == 0xe9) {
+        return true;
+    }
+    return site[0] == 0x0f && (site[1] & 0xf0) == 0x80;
+}
+
+bool is_got_relocation(RelocationType type)
+{
+    return type == RelocationType::R_X86_64_GOTPCREL || type == RelocationType::R_X86_64_GOTPCRELX
+        || type == RelocationType::R_X86_64_REX_GOTPCRELX;
+}
+
+// 把经由 GOT 的访问松弛为直接访问，成功时原地改写指令：
+//   mov foo@GOTPCREL(%rip), %reg -> lea foo(%rip), %reg
+//   call *foo@GOTPCREL(%rip)     -> addr32 call foo
+//   jmp *foo@GOTPCREL(%rip)      -> nop; jmp foo
+bool relax_got_access(Site& site)
+{
+    uint8_t& opcode = site[0];
+    uint8_t& modrm = site[1];
+    if (opcode == 0x8b && (modrm & 0xc7) == 0x05) {
+        opcode = 0x8d;
+        return true;
+    }
+    if (opcode == 0xff && modrm == 0x15) {
+        opcode = 0x67;
+        modrm = 0xe8;
+        return true;
+    }
+    if (opcode == 0xff && modrm == 0x25) {
+        opcode = 0x90;
+        modrm = 0xe9;
+        return true;
+    }
+    return false;
+}
+
+const char* relocation_type_name(RelocationType type)
+{
+    switch (type) {
+    case RelocationType::R_X86_64_32:
+        return "R_X86_64_32";
+    case RelocationType::R_X86_64_PC32:
+        return "R_X86_64_PC32";
+    case RelocationType::R_X86_64_64:
+        return "R_X86_64_64";
+    case RelocationType::R_X86_64_32S:
+        return "R_X86_64_32S";
+    case RelocationType::R_X86_64_GOTPCREL:
+        return "R_X86_64_GOTPCREL";
+    case RelocationType::R_X86_64_GOTPCRELX:
+        return "R_X86_64_GOTPCRELX";
+    case RelocationType::R_X86_64_REX_GOTPCRELX:
+        return "R_X86_64_REX_GOTPCRELX";
+    }
+    return "UNKNOWN";
+}
+
+// 重定位程序：所有重定位预先解析成 (输出节, 节内偏移, 类型, 目标槽位, 加数) 的紧凑数组，
+// 按 (节, 类型, 偏移) 排序后由按类型特化的内核成段应用。
+// GOT 与跳板在降级时已解析成具体目标，程序中只剩 PC32/32/32S/64 四种写入方式
+struct RelocOp {
+    uint64_t offset; // 输出节内偏移
+    int64_t addend;
+    uint32_t section; // 输出节下标
+    uint32_t slot; // 目标槽位下标
+    RelocationType type;
+};
+
+struct RelocSlot {
+    int64_t value; // 目标相对映像起始处的偏移
+    std::string name; // 目标符号名，用于报错
+};
+
+struct RelocProgram {
+    std::vector<std::string> sections; // 输出节名
+    std::vector<uint64_t> section_offsets; // 输出节相对映像起始处的偏移
+    std::vector<RelocSlot> slots;
+    std::vector<RelocOp> ops;
+};
+
+template <typename T>
+void write_pod(std::ostream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool read_pod(std::istream& in, T& value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+void write_string(std::ostream& out, const std::string& str)
+{
+    write_pod(out, static_cast<uint32_t>(str.size()));
+    out.write(str.data(), str.size());
+}
+
+// 重定位值：绝对类型 S + A，PC 相对类型 S + A - P - 8（加数约定见 load_fle）。S、P 都是绝对地址
+constexpr int64_t relocation_value(RelocationType type, int64_t target, int64_t addend, int64_t place)
+{
+    return is_pc_relative(type) ? target + addend - place - 8 : target + addend;
+}
+
+// 每批先算出全部重定位值，整批做一次范围检查后再写回
+constexpr size_t RELOC_BATCH = 256;
+
+// 写回时直接按小端字存储
+static_assert(std::endian::native == std::endian::little, "FLE_ld writes relocations as little-endian words");
+
+template <RelocationType Type>
+constexpr bool relocation_in_range(int64_t value)
+{
+    if constexpr (Type == RelocationType::R_X86_64_64) {
+        return true;
+    } else if constexpr (Type == RelocationType::R_X86_64_32) {
+        // 无符号32位，值必须为正且在uint32范围内
+        return static_cast<uint64_t>(value) <= UINT32_MAX;
+    } else {
+        // 有符号32位；PC 相对偏移必须在 ±2GB 内（跳转已尽量改走跳板）
+        return value == static_cast<int32_t>(value);
+    }
+}
+
+template <RelocationType Type>
+[[noreturn]] void relocation_out_of_range(const RelocOp& op, const std::vector<RelocSlot>& slots)
+{
+    if constexpr (is_pc_relative(Type)) {
+        throw std::runtime_error(std::string("Relocation value out of range for ")
+            + relocation_type_name(Type) + ": " + slots[op.slot].name);
+    } else {
+        throw std::runtime_error(std::string("Relocation value out of range for ") + relocation_type_name(Type));
+    }
+}
+
+// 按类型特化的内核：值的计算、范围检查与写入宽度都在编译期确定。
+// window 是输出节中从 window_offset 开始的一段，ops 都落在其中
+template <RelocationType Type>
+void apply_relocations(std::span<uint8_t> window, uint64_t window_offset, uint64_t section_offset,
+    std::span<const RelocOp> ops, const std::vector<RelocSlot>& slots)
+{
+    using Word = std::conditional_t<Type == RelocationType::R_X86_64_64, uint64_t, uint32_t>;
+    if (!ops.empty() && ops.back().offset + sizeof(Word) > window_offset + window.size()) {
+        throw std::runtime_error("Relocation program does not match the output sections");
+    }
+
+    int64_t values[RELOC_BATCH];
+    for (size_t base = 0; base < ops.size(); base += RELOC_BATCH) {
+        const auto batch = ops.subspan(base, std::min(RELOC_BATCH, ops.size() - base));
+        for (size_t i = 0; i != batch.size(); ++i) {
+            values[i] = relocation_value(Type, slots[batch[i].slot].value, batch[i].addend, section_offset + batch[i].offset);
+        }
+
+        // 无分支地归约整批的检查结果，只有出错时才回头找出是哪一项
+        bool in_range = true;
+        for (size_t i = 0; i != batch.size(); ++i) {
+            in_range &= relocation_in_range<Type>(values[i]);
+        }
+        if (!in_range) {
+            for (size_t i = 0; i != batch.size(); ++i) {
+                if (!relocation_in_range<Type>(values[i])) {
+                    relocation_out_of_range<Type>(batch[i], slots);
+                }
+            }
+        }
+
+        for (size_t i = 0; i != batch.size(); ++i) {
+            const Word word = static_cast<Word>(values[i]);
+            std::memcpy(window.data() + (batch[i].offset - window_offset), &word, sizeof(word));
+        }
+    }
+}
+
+// 应用输出节 section 中落在 [window_offset, window_offset + window.size()) 内的重定位。
+// 该节的程序按类型切成连续的段，每段二分出窗口内的部分交给对应的特化内核
+void apply_relocation_window(const RelocProgram& program, uint32_t section, uint64_t window_offset, std::span<uint8_t> window)
+{
+    auto begin = std::lower_bound(program.ops.begin(), program.ops.end(), section,
+        [](const RelocOp& op, uint32_t index) { return op.section < index; });
+    auto last = std::upper_bound(begin, program.ops.end(), section,
+        [](uint32_t index, const RelocOp& op) { return index < op.section; });
+    const uint64_t section_offset = program.section_offsets[section];
+    const uint64_t window_end = window_offset + window.size();
+
+    while (begin != last) {
+        auto end = std::find_if(begin, last, [&](const RelocOp& op) { return op.type != begin->type; });
+        auto first = std::lower_bound(begin, end, window_offset,
+            [](const RelocOp& op, uint64_t offset) { return op.offset < offset; });
+        auto stop = std::lower_bound(first, end, window_end,
+            [](const RelocOp& op, uint64_t offset) { return op.offset < offset; });
+        const std::span<const RelocOp> ops(first, stop);
+
+        switch (begin->type) {
+        case RelocationType::R_X86_64_PC32:
+            apply_relocations<RelocationType::R_X86_64_PC32>(window, window_offset, section_offset, ops, program.slots);
+            break;
+        case RelocationType::R_X86_64_32:
+            apply_relocations<RelocationType::R_X86_64_32>(window, window_offset, section_offset, ops, program.slots);
+            break;
+        case RelocationType::R_X86_64_32S:
+            apply_relocations<RelocationType::R_X86_64_32S>(window, window_offset, section_offset, ops, program.slots);
+            break;
+        case RelocationType::R_X86_64_64:
+            apply_relocations<RelocationType::R_X86_64_64>(window, window_offset, section_offset, ops, program.slots);
+            break;
+        default:
+            throw std::runtime_error("Unsupported relocation type");
+        }
+        begin = end;
+    }
+}
+
+// 链接所需的输入节元数据。规划阶段只用这些信息，节内容到写出时才读取
+struct SectionInfo {
+    uint64_t size; // 数据长度，BSS 节为 bss_size
+    std::vector<Relocation> relocs;
+    std::vector<Site> sites; // 与 relocs 一一对应
+};
+
+struct ObjectInfo {
+    std::string name;
+    std::map<std::string, SectionInfo> sections;
+    std::vector<Symbol> symbols;
+    std::vector<SectionGroup> groups;
+};
+
+ObjectInfo describe_object(const FLEObject& obj)
+{
+    ObjectInfo info { .name = obj.name, .sections = {}, .symbols = obj.symbols, .groups = obj.groups };
+    for (const auto& [name, section] : obj.sections) {
+        SectionInfo section_info {
+            .size = is_bss_section(name) ? section.bss_size : section.data.size(),
+            .relocs = section.relocs,
+            .sites = {},
+        };
+        for (const auto& reloc : section.relocs) {
+            Site site {};
+            for (size_t k = 0; k != site.size(); ++k) {
+                if (reloc.offset + k >= 2 && reloc.offset + k - 2 < section.data.size()) {
+                    site[k] = section.data[reloc.offset + k - 2];
+                }
+            }
+            section_info.sites.push_back(site);
+        }
+        info.sections.emplace(name, std::move(section_info));
+    }
+    return info;
+}
+
+// 按需读取的 ELF 输入：节内容只按窗口读出重定位处之前的指令字节，不整节读入
+constexpr uint64_t SITE_WINDOW = 0x10000;
+
+ObjectInfo describe_object(ElfObjectReader& reader)
+{
+    const FLEObject& obj = reader.object();
+    ObjectInfo info { .name = obj.name, .sections = {}, .symbols = obj.symbols, .groups = obj.groups };
+    for (const auto& [name, section] : obj.sections) {
+        const uint64_t size = reader.section_size(name);
+        SectionInfo section_info {
+            .size = size,
+            .relocs = section.relocs,
+            .sites = std::vector<Site>(section.relocs.size()),
+        };
+        // 按偏移顺序处理，相邻的重定位共用一个窗口
+        std::vector<size_t> order(section.relocs.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(),
+            [&](size_t lhs, size_t rhs) { return section.relocs[lhs].offset < section.relocs[rhs].offset; });
+
+        std::vector<uint8_t> window;
+        uint64_t window_offset = 0;
+        for (size_t k : order) {
+            const uint64_t offset = section.relocs[k].offset;
+            auto& site = section_info.sites[k];
+            const uint64_t first = offset < site.size() ? 0 : offset - site.size();
+            if (first < window_offset || offset > window_offset + window.size()) {
+                window_offset = first;
+                window = reader.read(name, first, std::min(SITE_WINDOW, size - first));
+            }
+            for (size_t j = 0; j != site.size(); ++j) {
+                if (offset + j >= site.size()) {
+                    site[j] = window[offset + j - site.size() - window_offset];
+                }
+            }
+        }
+        info.sections.emplace(name, std::move(section_info));
+    }
+    return info;
+}
+
+// GOT 松弛对指令的改写：输入节内偏移处的两个字节换成 bytes
+struct SitePatch {
+    uint64_t offset;
+    Site bytes;
+};
+
+// 输出节中来自某个输入节的一块
+struct Piece {
+    size_t object_index;
+    std::string section; // 输入节名
+    uint64_t offset; // 在输出节中的偏移
+    uint64_t size;
+    std::vector<SitePatch> patches;
+};
+
+struct OutputSection {
+    std::string name;
+    uint64_t size;
+    bool bss;
+    std::vector<Piece> pieces;
+    std::vector<uint8_t> synthesized; // 链接器合成节（跳板、GOT）的内容
+};
+
+// 链接计划：布局、符号解析与重定位程序都已确定，只差读入节内容并写出
+struct LinkPlan {
+    FLEObject result; // 不含节内容的可执行文件：程序头、节头与入口
+    std::vector<OutputSection> sections; // 与 result.phdrs、program.sections 一一对应
+    RelocProgram program;
+    std::array<uint8_t, 32> key {}; // 缓存键（见 link_plan_key），未启用缓存时全零
+    bool cached = false; // 整个计划取自缓存
+};
+
+void apply_patches(std::span<uint8_t> data, const Piece& piece)
+{
+    for (const auto& patch : piece.patches) {
+        std::copy(patch.bytes.begin(), patch.bytes.end(), data.begin() + patch.offset);
+    }
+}
+
+// 在 threads 个工作线程上运行 fn(worker)，worker 取值 [0, threads)
+template <typename Fn>
+void run_workers(unsigned threads, Fn&& fn)
+{
+    if (threads <= 1) {
+        fn(0u);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker != threads; ++worker) {
+        workers.emplace_back(fn, worker);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned worker_count(const LinkOptions& options)
+{
+    return options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// 符号解析的线程数：显式的 --threads 照办；默认每个线程至少分到 SYMBOLS_PER_WORKER 个符号，
+// 小链接串行完成，不为建线程付出比解析本身还大的开销
+constexpr size_t SYMBOLS_PER_WORKER = 8192;
+
+unsigned symbol_worker_count(const LinkOptions& options, size_t symbols)
+{
+    if (options.threads) {
+        return options.threads;
+    }
+    return static_cast<unsigned>(std::clamp<size_t>(symbols / SYMBOLS_PER_WORKER, 1, worker_count(options)));
+}
+
+// build-id：输出节的内容按块切成叶子并行哈希，根哈希覆盖布局与全部叶子摘要，
+// 叶子与根都用 SHA-256（叶子前缀 0x00、根前缀 0x01 区分），根摘要截取前 128 位。
+// 叶子只取决于节内偏移与内容，内存链接与流式链接得到相同的结果
+constexpr uint64_t BUILD_ID_CHUNK = 0x10000;
+constexpr uint64_t BUILD_ID_BUFFER_CHUNKS = 4; // 流式写出时每个工作线程攒够的块数
+constexpr size_t BUILD_ID_LENGTH = 32; // 128 位摘要的十六进制长度
+
+// SHA-256（FIPS 180-4）
+class Sha256 {
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    void update(std::span<const uint8_t> data)
+    {
+        total += data.size();
+        size_t i = 0;
+        if (used) {
+            i = std::min(data.size(), block.size() - used);
+            std::memcpy(block.data() + used, data.data(), i);
+            used += i;
+            if (used != block.size()) {
+                return;
+            }
+            compress(block.data());
+            used = 0;
+        }
+        for (; i + block.size() <= data.size(); i += block.size()) {
+            compress(data.data() + i);
+        }
+        std::memcpy(block.data(), data.data() + i, data.size() - i);
+        used = data.size() - i;
+    }
+
+    Digest finish()
+    {
+        const uint64_t bits = total * 8;
+        // 补一个 0x80 和若干 0，使长度字段恰好落在块的最后 8 字节
+        static constexpr uint8_t PADDING[64] = { 0x80 };
+        update(std::span(PADDING, 1 + (119 - used) % 64));
+        uint8_t length[8];
+        for (size_t i = 0; i != 8; ++i) {
+            length[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        }
+        update(length);
+
+        Digest digest;
+        for (size_t i = 0; i != state.size(); ++i) {
+            for (size_t j = 0; j != 4; ++j) {
+                digest[i * 4 + j] = static_cast<uint8_t>(state[i] >> (24 - 8 * j));
+            }
+        }
+        return digest;
+    }
+
+private:
+    static constexpr uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    void compress(const uint8_t* chunk)
+    {
+        uint32_t w[64];
+        for (size_t i = 0; i != 16; ++i) {
+            w[i] = uint32_t(chunk[i * 4]) << 24 | uint32_t(chunk[i * 4 + 1]) << 16
+                | uint32_t(chunk[i * 4 + 2]) << 8 | uint32_t(chunk[i * 4 + 3]);
+        }
+        for (size_t i = 16; i != 64; ++i) {
+            const uint32_t s0 = std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto [a, b, c, d, e, f, g, h] = state;
+        for (size_t i = 0; i != 64; ++i) {
+            const uint32_t t1 = h + (std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            const uint32_t t2 = (std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        const uint32_t next[8] = { a, b, c, d, e, f, g, h };
+        for (size_t i = 0; i != state.size(); ++i) {
+            state[i] += next[i];
+        }
+    }
+
+    std::array<uint32_t, 8> state = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    std::array<uint8_t, 64> block {};
+    size_t used = 0;
+    uint64_t total = 0;
+};
+
+class BuildIdHasher {
+public:
+    explicit BuildIdHasher(unsigned threads)
+        : threads(threads)
+    {
+    }
+
+    // data 必须保持有效直到下一次 flush()
+    void add(uint32_t section, uint64_t offset, std::span<const uint8_t> data)
+    {
+        for (uint64_t pos = 0; pos < data.size(); pos += BUILD_ID_CHUNK) {
+            leaves.push_back({ section, offset + pos, data.subspan(pos, std::min(BUILD_ID_CHUNK, data.size() - pos)), {} });
+        }
+    }
+
+    // 流式写出用：内容复制进有界的缓冲区，调用者可以立即释放 data；
+    // 缓冲区攒满（每个工作线程 BUILD_ID_BUFFER_CHUNKS 块）才并行哈希一批
+    void add_buffered(uint32_t section, uint64_t offset, std::span<const uint8_t> data)
+    {
+        for (uint64_t pos = 0; pos < data.size(); pos += BUILD_ID_CHUNK) {
+            const auto chunk = data.subspan(pos, std::min(BUILD_ID_CHUNK, data.size() - pos));
+            const auto& copy = buffered.emplace_back(chunk.begin(), chunk.end());
+            leaves.push_back({ section, offset + pos, copy, {} });
+            buffered_bytes += copy.size();
+            if (buffered_bytes >= threads * BUILD_ID_BUFFER_CHUNKS * BUILD_ID_CHUNK) {
+                flush();
+            }
+        }
+    }
+
+    void flush()
+    {
+        const size_t pending = leaves.size() - hashed;
+        const unsigned workers = std::min<size_t>(threads, pending);
+        run_workers(workers, [&](unsigned worker) {
+            for (size_t i = hashed + worker; i < leaves.size(); i += std::max(1u, workers)) {
+                Sha256 sha;
+                static constexpr uint8_t LEAF = 0x00;
+                sha.update(std::span(&LEAF, 1));
+                sha.update(leaves[i].data);
+                leaves[i].digest = sha.finish();
+                leaves[i].data = {};
+            }
+        });
+        hashed = leaves.size();
+        buffered.clear();
+        buffered_bytes = 0;
+    }
+
+    std::string finish(const FLEObject& exe)
+    {
+        flush();
+        std::sort(leaves.begin(), leaves.end(), [](const Leaf& lhs, const Leaf& rhs) {
+            return std::tie(lhs.section, lhs.offset) < std::tie(rhs.section, rhs.offset);
+        });
+
+        Sha256 root;
+        static constexpr uint8_t ROOT = 0x01;
+        root.update(std::span(&ROOT, 1));
+        auto put = [&](uint64_t value) {
+            root.update(std::span(reinterpret_cast<const uint8_t*>(&value), sizeof(value)));
+        };
+        put(exe.entry);
+        for (const auto& phdr : exe.phdrs) {
+            put(phdr.name.size());
+            root.update(std::span(reinterpret_cast<const uint8_t*>(phdr.name.data()), phdr.name.size()));
+            put(phdr.vaddr);
+            put(phdr.size);
+            put(phdr.flags);
+            put(phdr.align);
+        }
+        // 能否平移到其他基址也是映像的一部分
+        if (exe.dynamic_relocs) {
+            for (const auto* sites : { &exe.dynamic_relocs->abs64, &exe.dynamic_relocs->abs32, &exe.dynamic_relocs->abs32s }) {
+                put(sites->size());
+                for (uint64_t site : *sites) {
+                    put(site);
+                }
+            }
+        }
+        put(leaves.size());
+        for (const auto& leaf : leaves) {
+            put(leaf.section);
+            put(leaf.offset);
+            root.update(leaf.digest);
+        }
+
+        const Sha256::Digest digest = root.finish();
+        std::ostringstream hex;
+        hex << std::hex << std::setfill('0');
+        for (size_t i = 0; i != BUILD_ID_LENGTH / 2; ++i) {
+            hex << std::setw(2) << static_cast<unsigned>(digest[i]);
+        }
+        return hex.str();
+    }
+
+private:
+    struct Leaf {
+        uint32_t section;
+        uint64_t offset;
+        std::span<const uint8_t> data;
+        Sha256::Digest digest;
+    };
+    unsigned threads;
+    std::vector<Leaf> leaves;
+    size_t hashed = 0;
+    std::deque<std::vector<uint8_t>> buffered; // add_buffered 复制的内容，deque 扩容不移动已有元素
+    uint64_t buffered_bytes = 0;
+};
+
+// 链接计划缓存。键是全部输入元数据（符号、节长度、重定位及重定位处之前的指令字节、
+// 节组）与影响布局的链接选项的 SHA-256，在符号解析之前算出；命中时跳过解析、布局、
+// GOT 松弛、跳板与重定位降级，直接按保存的计划读入节内容并写出。
+// 节内容不参与规划，只改了数据而元数据不变时计划照样可用
+constexpr char LINK_PLAN_MAGIC[8] = { 'F', 'L', 'E', 'P', 'L', 'A', 'N', '\0' };
+constexpr uint32_t LINK_PLAN_VERSION = 1;
+
+// 缓存读写与计算键共用同一份字段清单：plan_fields 依次列出一个结构要保存的字段，
+// Io 是 PlanWriter 或 PlanReader
+template <typename S, typename T>
+concept PlanRecord = std::same_as<std::remove_const_t<S>, T>;
+
+template <typename Io, PlanRecord<Relocation> S>
+void plan_fields(Io& io, S& reloc)
+{
+    io.field(reloc.type);
+    io.field(reloc.offset);
+    io.field(reloc.symbol);
+    io.field(reloc.addend);
+}
+
+template <typename Io, PlanRecord<Symbol> S>
+void plan_fields(Io& io, S& sym)
+{
+    io.field(sym.type);
+    io.field(sym.section);
+    io.field(sym.offset);
+    io.field(sym.size);
+    io.field(sym.name);
+}
+
+template <typename Io, PlanRecord<SectionGroup> S>
+void plan_fields(Io& io, S& group)
+{
+    io.field(group.signature);
+    io.field(group.sections);
+}
+
+template <typename Io, PlanRecord<SectionInfo> S>
+void plan_fields(Io& io, S& section)
+{
+    io.field(section.size);
+    io.field(section.relocs);
+    io.field(section.sites);
+}
+
+template <typename Io, PlanRecord<ObjectInfo> S>
+void plan_fields(Io& io, S& info)
+{
+    io.field(info.name);
+    io.field(info.sections);
+    io.field(info.symbols);
+    io.field(info.groups);
+}
+
+template <typename Io, PlanRecord<InputSectionRule> S>
+void plan_fields(Io& io, S& rule)
+{
+    io.field(rule.file);
+    io.field(rule.sections);
+}
+
+template <typename Io, PlanRecord<OutputSectionRule> S>
+void plan_fields(Io& io, S& rule)
+{
+    io.field(rule.name);
+    io.field(rule.inputs);
+    io.field(rule.align);
+    io.field(rule.subalign);
+    io.field(rule.flags);
+}
+
+// threads 与缓存路径不影响输出，不进键
+template <typename Io, PlanRecord<LinkOptions> S>
+void plan_fields(Io& io, S& options)
+{
+    io.field(options.hugepage_text);
+    io.field(options.discard_locals);
+    io.field(options.pie);
+    io.field(options.layout.base);
+    io.field(options.layout.sections);
+}
+
+template <typename Io, PlanRecord<ProgramHeader> S>
+void plan_fields(Io& io, S& phdr)
+{
+    io.field(phdr.name);
+    io.field(phdr.vaddr);
+    io.field(phdr.size);
+    io.field(phdr.flags);
+    io.field(phdr.align);
+}
+
+template <typename Io, PlanRecord<SectionHeader> S>
+void plan_fields(Io& io, S& shdr)
+{
+    io.field(shdr.name);
+    io.field(shdr.type);
+    io.field(shdr.flags);
+    io.field(shdr.addr);
+    io.field(shdr.offset);
+    io.field(shdr.size);
+    io.field(shdr.addralign);
+}
+
+template <typename Io, PlanRecord<DynamicRelocs> S>
+void plan_fields(Io& io, S& relocs)
+{
+    io.field(relocs.abs64);
+    io.field(relocs.abs32);
+    io.field(relocs.abs32s);
+}
+
+template <typename Io, PlanRecord<Piece> S>
+void plan_fields(Io& io, S& piece)
+{
+    io.field(piece.object_index);
+    io.field(piece.section);
+    io.field(piece.offset);
+    io.field(piece.size);
+    io.field(piece.patches);
+}
+
+template <typename Io, PlanRecord<OutputSection> S>
+void plan_fields(Io& io, S& section)
+{
+    io.field(section.name);
+    io.field(section.size);
+    io.field(section.bss);
+    io.field(section.pieces);
+    io.field(section.synthesized);
+}
+
+template <typename Io, PlanRecord<RelocSlot> S>
+void plan_fields(Io& io, S& slot)
+{
+    io.field(slot.value);
+    io.field(slot.name);
+}
+
+// 结果只保存 plan_link 填写的部分，节内容写出时才生成
+template <typename Io, PlanRecord<LinkPlan> S>
+void plan_fields(Io& io, S& plan)
+{
+    io.field(plan.result.type);
+    io.field(plan.result.phdrs);
+    io.field(plan.result.shdrs);
+    io.field(plan.result.symbols);
+    io.field(plan.result.symbol_index);
+    io.field(plan.result.entry);
+    io.field(plan.result.dynamic_relocs);
+    io.field(plan.sections);
+    io.field(plan.program.sections);
+    io.field(plan.program.section_offsets);
+    io.field(plan.program.slots);
+    io.field(plan.program.ops);
+}
+
+class PlanWriter {
+public:
+    explicit PlanWriter(std::ostream& out)
+        : out(out)
+    {
+    }
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    void field(const T& value)
+    {
+        write_pod(out, value);
+    }
+
+    void field(const std::string& str) { write_string(out, str); }
+
+    template <typename T>
+    void field(const std::vector<T>& items)
+    {
+        write_pod(out, static_cast<uint64_t>(items.size()));
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            out.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+        } else {
+            for (const auto& item : items) {
+                field(item);
+            }
+        }
+    }
+
+    template <typename V>
+    void field(const std::map<std::string, V>& items)
+    {
+        write_pod(out, static_cast<uint64_t>(items.size()));
+        for (const auto& [key, value] : items) {
+            field(key);
+            field(value);
+        }
+    }
+
+    template <typename T>
+    void field(const std::optional<T>& value)
+    {
+        field(value.has_value());
+        if (value) {
+            field(*value);
+        }
+    }
+
+    template <typename T>
+        requires(!std::is_trivially_copyable_v<T>)
+    void field(const T& record)
+    {
+        plan_fields(*this, record);
+    }
+
+private:
+    std::ostream& out;
+};
+
+// 读出的长度都不超过文件剩余的字节数，损坏的缓存不会引发巨大的分配
+class PlanReader {
+public:
+    PlanReader(std::istream& in, uint64_t limit)
+        : in(in)
+        , limit(limit)
+    {
+    }
+
+    bool ok() const { return !failed && static_cast<bool>(in); }
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    void field(T& value)
+    {
+        failed |= !read_pod(in, value);
+    }
+
+    void field(std::string& str)
+    {
+        uint32_t size = 0;
+        field(size);
+        if (ok() && fits(size)) {
+            str.resize(size);
+            in.read(str.data(), size);
+        }
+    }
+
+    template <typename T>
+    void field(std::vector<T>& items)
+    {
+        uint64_t size = 0;
+        field(size);
+        if (!ok() || !fits(size)) {
+            return;
+        }
+        items.resize(size);
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (fits(size * sizeof(T))) {
+                in.read(reinterpret_cast<char*>(items.data()), size * sizeof(T));
+            }
+        } else {
+            for (auto& item : items) {
+                field(item);
+            }
+        }
+    }
+
+    template <typename T>
+    void field(std::optional<T>& value)
+    {
+        bool present = false;
+        field(present);
+        if (ok() && present) {
+            field(value.emplace());
+        }
+    }
+
+    template <typename T>
+        requires(!std::is_trivially_copyable_v<T>)
+    void field(T& record)
+    {
+        plan_fields(*this, record);
+    }
+
+private:
+    bool fits(uint64_t bytes)
+    {
+        failed |= bytes > limit;
+        return !failed;
+    }
+
+    std::istream& in;
+    uint64_t limit;
+    bool failed = false;
+};
+
+// 把写入的字节直接喂给 SHA-256，计算键时不必先序列化到内存
+class HashBuffer : public std::streambuf {
+public:
+    Sha256 sha;
+
+protected:
+    int overflow(int c) override
+    {
+        if (c != traits_type::eof()) {
+            const auto byte = static_cast<uint8_t>(c);
+            sha.update(std::span(&byte, 1));
+        }
+        return c;
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        sha.update(std::span(reinterpret_cast<const uint8_t*>(data), static_cast<size_t>(size)));
+        return size;
+    }
+};
+
+Sha256::Digest link_plan_key(const std::vector<ObjectInfo>& objects, const LinkOptions& options)
+{
+    HashBuffer buffer;
+    std::ostream out(&buffer);
+    PlanWriter writer(out);
+    writer.field(LINK_PLAN_VERSION);
+    writer.field(options);
+    writer.field(objects);
+    return buffer.sha.finish();
+}
+
+void save_link_plan(const LinkPlan& plan, const std::string& path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot open link plan cache: " + path);
+    }
+    out.write(LINK_PLAN_MAGIC, sizeof(LINK_PLAN_MAGIC));
+    PlanWriter writer(out);
+    writer.field(LINK_PLAN_VERSION);
+    writer.field(plan.key);
+    writer.field(plan);
+}
+
+// 缓存缺失、损坏或键不符时返回空，由调用者重新规划
+std::optional<LinkPlan> load_link_plan(const std::string& path, const Sha256::Digest& key, size_t object_count)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return std::nullopt;
+    }
+    const auto size = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+
+    char magic[sizeof(LINK_PLAN_MAGIC)];
+    uint32_t version = 0;
+    LinkPlan plan;
+    PlanReader reader(in, size);
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, LINK_PLAN_MAGIC, sizeof(magic)) != 0) {
+        return std::nullopt;
+    }
+    reader.field(version);
+    reader.field(plan.key);
+    if (!reader.ok() || version != LINK_PLAN_VERSION || plan.key != key) {
+        return std::nullopt;
+    }
+    reader.field(plan);
+    if (!reader.ok()) {
+        return std::nullopt;
+    }
+
+    // 各表之间的下标关系
+    const auto& program = plan.program;
+    const size_t section_count = plan.sections.size();
+    if (plan.result.phdrs.size() != section_count || program.sections.size() != section_count
+        || program.section_offsets.size() != section_count) {
+        return std::nullopt;
+    }
+    for (const auto& op : program.ops) {
+        if (op.section >= section_count || op.slot >= program.slots.size()) {
+            return std::nullopt;
+        }
+    }
+    for (const auto& section : plan.sections) {
+        for (const auto& piece : section.pieces) {
+            if (piece.object_index >= object_count || piece.offset + piece.size > section.size) {
+                return std::nullopt;
+            }
+            for (const auto& patch : piece.patches) {
+                if (patch.offset + patch.bytes.size() > piece.size) {
+                    return std::nullopt;
+                }
+            }
+        }
+    }
+    plan.cached = true;
+    return plan;
+}
+
+// 重定位全部应用成功后才缓存链接计划
+void finish_link(const LinkPlan& plan, const LinkOptions& options, const std::string& build_id)
+{
+    if (!plan.cached && !options.reloc_cache.empty()) {
+        save_link_plan(plan, options.reloc_cache);
+    }
+
+    std::cout << "\n=== Phase 4: Finalizing ===\n";
+    std::cout << "Entry point: 0x" << std::hex << plan.result.entry << std::dec << std::endl;
+    uint64_t text_size = 0;
+    for (const auto& section : plan.sections) {
+        if (section.name == ".text") {
+            text_size = section.size;
+        }
+    }
+    std::cout << "Total size: 0x" << std::hex << text_size << std::dec << " bytes\n";
+    std::cout << "Build ID: " << build_id << std::endl;
+}
+
+LinkPlan plan_link(const std::vector<ObjectInfo>& objects, const LinkOptions& options)
 {
     if (objects.empty()) {
         throw std::runtime_error("No input objects specified.");
     }
 
-    FLEObject result;
-    result.type = ".exe";
+    Sha256::Digest key {};
+    if (!options.reloc_cache.empty()) {
+        key = link_plan_key(objects, options);
+        if (auto cached = load_link_plan(options.reloc_cache, key, objects.size())) {
+            std::cout << "Link plan: replaying " << cached->sections.size() << " sections, "
+                      << cached->program.ops.size() << " relocations from " << options.reloc_cache << std::endl;
+            return std::move(*cached);
+        }
+    }
+
+    LinkPlan plan;
+    plan.key = key;
+    FLEObject& result = plan.result;
+    result.type = ".exe";
+
+    using SectionName = std::string;
+    struct RawSection {
+        SectionName name; // 输入节名
+        SectionName output; // 所属输出节名
+        std::string file_name;
+        size_t object_index;
+        SectionInfo section;
+        uint64_t offset;
+        uint64_t global_offset;
+        std::vector<SitePatch> patches;
+    };
+
+    // 0. COMDAT: 同一签名的节组只保留第一次出现的那份，其余组的节整体丢弃
+    std::vector<std::set<SectionName>> discarded_sections(objects.size());
+    std::set<std::string> kept_groups;
+    for (size_t i = 0; i != objects.size(); ++i) {
+        for (const auto& group : objects[i].groups) {
+            if (kept_groups.insert(group.signature).second)
+                continue;
+            std::cout << "Discarding COMDAT group " << group.signature << " from " << objects[i].name << std::endl;
+            discarded_sections[i].insert(group.sections.begin(), group.sections.end());
+        }
+    }
+
+    // 布局文件中的输出节规则；输入节取第一条匹配的规则，没有匹配时自成一节
+    const auto& rules = options.layout.sections;
+    const uint64_t base = options.layout.base.value_or(BASE_VADDR);
+    auto find_rule = [&](const SectionName& output) -> const OutputSectionRule* {
+        auto it = std::find_if(rules.begin(), rules.end(), [&](const OutputSectionRule& rule) { return rule.name == output; });
+        return it != rules.end() ? &*it : nullptr;
+    };
+    auto output_for = [&](const std::string& file, const SectionName& input) -> SectionName {
+        auto matches = [](const std::string& pattern, const std::string& name) {
+            return fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+        };
+        for (const auto& rule : rules) {
+            for (const auto& input_rule : rule.inputs) {
+                if (!matches(input_rule.file, file))
+                    continue;
+                for (const auto& pattern : input_rule.sections) {
+                    if (matches(pattern, input)) {
+                        return rule.name;
+                    }
+                }
+            }
+        }
+        return input;
+    };
 
-    using SectionName = std::string;
-    struct RawSection {
-        std::string file_name;
-        FLESection section;
-        int offset;
-        int global_offset;
+    // 段权限：布局文件的 FLAGS 优先，布局文件中的其他输出节取所含输入节权限的并集，
+    // 其余的节按节名推断
+    auto flags_by_name = [](const SectionName& name) -> uint32_t {
+        if (is_text_section(name)) {
+            return static_cast<uint32_t>(PHF::R) | static_cast<uint32_t>(PHF::X);
+        } else if (section_in(name, ".rodata") || section_in(name, ".lrodata") || name == GOT_SECTION) {
+            return static_cast<uint32_t>(PHF::R);
+        } else if (section_in(name, ".data") || section_in(name, ".ldata") || is_bss_section(name)) {
+            return static_cast<uint32_t>(PHF::R) | static_cast<uint32_t>(PHF::W);
+        }
+        return 0;
+    };
+    std::map<SectionName, uint32_t> rule_flags; // 收集完输入节后填入
+    auto section_flags = [&](const SectionName& name) -> uint32_t {
+        auto it = rule_flags.find(name);
+        return it != rule_flags.end() ? it->second : flags_by_name(name);
+    };
+    auto is_code = [&](const SectionName& name) {
+        return (section_flags(name) & static_cast<uint32_t>(PHF::X)) != 0;
     };
 
     // 1. Collect all sections
-    std::map<SectionName, std::vector<RawSection>> section_groups;
+    std::map<SectionName, std::vector<RawSection>> section_groups; // 输出节名 -> 输入节
     std::vector<SectionName> ordered_section_names;
+    std::set<SectionName> input_section_names;
+    // 每个目标文件的输入节名 -> (输出节名, 在 section_groups[输出节名] 中的下标)
+    std::vector<std::map<SectionName, std::pair<SectionName, size_t>>> object_sections(objects.size());
 
-    for (const auto& obj : objects) {
+    for (size_t i = 0; i != objects.size(); ++i) {
+        const auto& obj = objects[i];
         for (const auto& [section_name, raw_section] : obj.sections) {
-            if (!raw_section.data.size() && raw_section.bss_size == 0)
+            if (!raw_section.size)
+                continue;
+            if (discarded_sections[i].contains(section_name))
                 continue;
 
-            section_groups[section_name].push_back({
+            const SectionName output = output_for(obj.name, section_name);
+            if (is_bss_section(output) && !is_bss_section(section_name)) {
+                throw std::runtime_error("Cannot place section " + section_name + " from " + obj.name
+                    + " into BSS output section " + output);
+            }
+            input_section_names.insert(section_name);
+            object_sections[i][section_name] = { output, section_groups[output].size() };
+            section_groups[output].push_back({
+                .name = section_name,
+                .output = output,
                 .file_name = obj.name,
+                .object_index = i,
                 .section = raw_section,
                 .offset = 0, // To be calculated later
                 .global_offset = 0, // To be calculated later
+                .patches = {},
             });
-            if (std::find(ordered_section_names.begin(), ordered_section_names.end(), section_name) == ordered_section_names.end()) {
-                ordered_section_names.push_back(section_name);
+            if (std::find(ordered_section_names.begin(), ordered_section_names.end(), output) == ordered_section_names.end()) {
+                ordered_section_names.push_back(output);
             }
         }
     }
 
-    // 2. Merge sections and generate program headers
+    for (const auto& rule : rules) {
+        uint32_t flags = 0;
+        if (rule.flags) {
+            flags = *rule.flags;
+        } else if (auto it = section_groups.find(rule.name); it != section_groups.end()) {
+            for (const auto& raw_section : it->second) {
+                const uint32_t member_flags = flags_by_name(raw_section.name);
+                if (!member_flags) {
+                    throw std::runtime_error("Cannot derive flags of output section " + rule.name + " from input section "
+                        + raw_section.name + " in " + raw_section.file_name + ", add FLAGS(...) to its layout rule");
+                }
+                flags |= member_flags;
+            }
+        }
+        rule_flags[rule.name] = flags;
+    }
 
-    uint64_t section_vaddr = 0;
-    constexpr uint64_t BASE_VADDR = 0x400000;
-    constexpr uint64_t PAGE_SIZE = 0x1000;
+    // 布局文件中的输出节按文件中的顺序排在前面；其余的节中，
+    // 大节放到最后，常规节保持在 32 位地址窗口内
+    auto section_rank = [&](const SectionName& name) -> size_t {
+        if (const auto* rule = find_rule(name)) {
+            return rule - rules.data();
+        }
+        return rules.size() + (is_large_section(name) ? 1 : 0);
+    };
+    std::stable_sort(ordered_section_names.begin(), ordered_section_names.end(),
+        [&](const SectionName& lhs, const SectionName& rhs) { return section_rank(lhs) < section_rank(rhs); });
 
-    for (auto name : ordered_section_names) {
-        std::cout << "\nMerging section: " << name << std::endl;
-        auto& sections = section_groups[name];
+    // 2. Collect all symbols
+    struct SymbolDef {
+        Symbol symbol;
+        const RawSection* raw; // 符号所在的输入节，最终地址 = raw->global_offset + symbol.offset
+    };
+    size_t symbol_count = 0;
+    for (const auto& obj : objects) {
+        symbol_count += obj.symbols.size();
+    }
+    const unsigned threads = symbol_worker_count(options, symbol_count);
 
-        FLESection merged_section;
-        size_t total_bss_size = 0;
+    std::cout << "\n=== Phase 2: Processing Symbols ===\n";
+    for (const auto& obj : objects) {
+        for (const auto& sym : obj.symbols) {
+            std::cout << "Symbol: " << sym.name
+                      << " from " << obj.name
+                      << " type=" << (sym.type == SymbolType::LOCAL ? "LOCAL" : sym.type == SymbolType::WEAK ? "WEAK"
+                                                                                                             : "GLOBAL")
+                      << " section=" << sym.section
+                      << " offset=0x" << std::hex << sym.offset << std::dec << std::endl;
+        }
+    }
+
+    // 各线程各自记录遇到的错误，最后报告输入顺序中最靠前的一个，
+    // 与串行处理时第一个抛出的错误相同，不受线程数影响
+    struct SymbolError {
+        size_t object;
+        size_t symbol;
+        std::string message;
+    };
+    std::vector<std::optional<SymbolError>> errors(threads);
+    auto record_error = [&](unsigned worker, size_t object, size_t symbol, std::string message) {
+        auto& slot = errors[worker];
+        if (!slot || std::pair(object, symbol) < std::pair(slot->object, slot->symbol)) {
+            slot = SymbolError { object, symbol, std::move(message) };
+        }
+    };
+
+    // 2a. 按目标文件分给各线程：定位符号所在的输入节，收集局部符号，
+    //     全局符号按名字哈希放进各分片的桶里，每个目标文件每个分片一个桶，桶内保持输入顺序
+    std::vector<std::unordered_map<std::string, SymbolDef>> local_symbols(objects.size());
+    std::vector<std::vector<const RawSection*>> symbol_sections(objects.size());
+    std::vector<std::vector<std::vector<uint32_t>>> shard_buckets(objects.size(), std::vector<std::vector<uint32_t>>(threads));
+
+    run_workers(threads, [&](unsigned worker) {
+        for (size_t i = worker; i < objects.size(); i += threads) {
+            const auto& obj = objects[i];
+            symbol_sections[i].assign(obj.symbols.size(), nullptr);
+
+            for (size_t j = 0; j != obj.symbols.size(); ++j) {
+                const auto& sym = obj.symbols[j];
+                // 被丢弃的 COMDAT 节中的符号由保留的那份提供
+                if (discarded_sections[i].contains(sym.section))
+                    continue;
+                auto section_it = object_sections[i].find(sym.section);
+                if (section_it == object_sections[i].end()) {
+                    record_error(worker, i, j, input_section_names.contains(sym.section)
+                            ? "Symbol " + sym.name + " in " + obj.name + " refers to non-existent section " + sym.section
+                            : "Symbol " + sym.name + " refers to non-existent section " + sym.section);
+                    continue;
+                }
+                const auto& [output, index] = section_it->second;
+                const RawSection* raw = &section_groups.find(output)->second[index];
+                symbol_sections[i][j] = raw;
+
+                if (sym.type == SymbolType::LOCAL) {
+                    local_symbols[i][sym.name] = SymbolDef { sym, raw };
+                } else {
+                    shard_buckets[i][std::hash<std::string> {}(sym.name) % threads].push_back(static_cast<uint32_t>(j));
+                }
+            }
+        }
+    });
+
+    // 2b. 每个线程独占一个分片，按输入顺序只遍历自己的桶并应用强弱规则：
+    //     强符号覆盖弱符号，多个强符号报错，多个弱符号取第一个
+    std::vector<std::unordered_map<std::string, SymbolDef>> global_shards(threads);
+
+    run_workers(threads, [&](unsigned shard) {
+        auto& global_symbols = global_shards[shard];
+        for (size_t i = 0; i != objects.size(); ++i) {
+            for (const uint32_t j : shard_buckets[i][shard]) {
+                const auto& sym = objects[i].symbols[j];
+
+                SymbolDef def { sym, symbol_sections[i][j] };
+                auto it = global_symbols.find(sym.name);
+                if (it == global_symbols.end()) {
+                    global_symbols.emplace(sym.name, std::move(def));
+                } else if (sym.type == SymbolType::GLOBAL && it->second.symbol.type == SymbolType::GLOBAL) {
+                    record_error(shard, i, j, "Multiple definition of strong symbol: " + sym.name);
+                } else if (sym.type == SymbolType::GLOBAL && it->second.symbol.type == SymbolType::WEAK) {
+                    it->second = std::move(def);
+                }
+            }
+        }
+    });
+
+    const std::optional<SymbolError>* first_error = nullptr;
+    for (const auto& error : errors) {
+        if (error && (!first_error || std::pair(error->object, error->symbol) < std::pair((*first_error)->object, (*first_error)->symbol))) {
+            first_error = &error;
+        }
+    }
+    if (first_error) {
+        throw std::runtime_error((*first_error)->message);
+    }
+
+    auto find_global = [&](const std::string& name) -> const SymbolDef* {
+        const auto& shard = global_shards[std::hash<std::string> {}(name) % threads];
+        auto it = shard.find(name);
+        return it != shard.end() ? &it->second : nullptr;
+    };
+
+    auto find_symbol = [&](const RawSection& raw, const std::string& name) -> const SymbolDef* {
+        // First, check if it's a local symbol
+        if (raw.object_index < local_symbols.size()) {
+            const auto& locals = local_symbols[raw.object_index];
+            auto local_it = locals.find(name);
+            if (local_it != locals.end()) {
+                return &local_it->second;
+            }
+        }
+        // Then, check if it's a global symbol
+        return find_global(name);
+    };
+
+    auto symbol_offset = [](const SymbolDef& def) -> int64_t {
+        return def.raw->global_offset + def.symbol.offset;
+    };
+
+    // 3. GOT: relax accesses to locally defined symbols, allocate .got slots for the rest
+    std::vector<const SymbolDef*> got_entries;
+    std::map<const SymbolDef*, size_t> got_index;
+    size_t relaxed_count = 0;
 
+    for (auto& [name, sections] : section_groups) {
         for (auto& raw_section : sections) {
-            raw_section.offset = merged_section.data.size();
-            raw_section.global_offset = section_vaddr + merged_section.data.size();
+            for (size_t k = 0; k != raw_section.section.relocs.size(); ++k) {
+                auto& reloc = raw_section.section.relocs[k];
+                auto& site = raw_section.section.sites[k];
+                if (!is_got_relocation(reloc.type))
+                    continue;
+
+                const SymbolDef* def = find_symbol(raw_section, reloc.symbol);
+                if (!def) {
+                    throw std::runtime_error("Undefined symbol: " + reloc.symbol);
+                }
+
+                // 静态链接中符号都在本映像内；大节可能超出 ±2GB，仍走 GOT
+                if (reloc.type != RelocationType::R_X86_64_GOTPCREL && !is_large_section(def->symbol.section)
+                    && relax_got_access(site)) {
+                    raw_section.patches.push_back(SitePatch { reloc.offset - 2, site });
+                    reloc.type = RelocationType::R_X86_64_PC32;
+                    ++relaxed_count;
+                    continue;
+                }
 
-            // 如果是 BSS 段，累加大小但不复制数据
-            if (name == ".bss") {
-                total_bss_size += raw_section.section.bss_size;
-            } else {
-                merged_section.data.insert(merged_section.data.end(),
-                    raw_section.section.data.begin(), raw_section.section.data.end());
+                if (!got_index.contains(def)) {
+                    got_index[def] = got_entries.size();
+                    got_entries.push_back(def);
+                }
             }
         }
+    }
+
+    if (!got_entries.empty()) {
+        section_groups[GOT_SECTION].push_back({
+            .name = GOT_SECTION,
+            .output = GOT_SECTION,
+            .file_name = "",
+            .object_index = objects.size(),
+            .section = { .size = got_entries.size() * GOT_ENTRY_SIZE, .relocs = {}, .sites = {} },
+            .offset = 0,
+            .global_offset = 0,
+            .patches = {},
+        });
+        auto first_large = std::find_if(ordered_section_names.begin(), ordered_section_names.end(), is_large_section);
+        ordered_section_names.insert(first_large, GOT_SECTION);
+    }
+    std::cout << "\nGOT: " << relaxed_count << " relaxed, " << got_entries.size() << " entries" << std::endl;
 
-        // 如果是 BSS 段，设置其总大小
-        if (name == ".bss") {
-            merged_section.bss_size = total_bss_size;
+    // 4. Layout sections, adding range-extension thunks for out-of-range branches
+    //    每个输出节是一个独立的段，起止都按段对齐，不与其他段共用页。
+    //    --hugepage-text 时代码段独占 2 MiB 对齐的区间，加载器才能用大页映射它
+    auto segment_align = [&](const SectionName& name) {
+        const auto* rule = find_rule(name);
+        if (rule && rule->align) {
+            return std::max(rule->align, PAGE_SIZE);
+        }
+        return options.hugepage_text && is_code(name) ? HUGE_PAGE_SIZE : PAGE_SIZE;
+    };
+    auto layout = [&]() {
+        uint64_t section_vaddr = base;
+        for (const auto& name : ordered_section_names) {
+            const uint64_t align = segment_align(name);
+            const auto* rule = find_rule(name);
+            const uint64_t subalign = rule && rule->subalign ? rule->subalign : 1;
+            section_vaddr = (section_vaddr + align - 1) & ~(align - 1);
+            uint64_t size = 0;
+            for (auto& raw_section : section_groups[name]) {
+                size = (size + subalign - 1) & ~(subalign - 1);
+                raw_section.offset = size;
+                raw_section.global_offset = section_vaddr + size;
+                size += raw_section.section.size;
+            }
+            section_vaddr += size;
+            section_vaddr = (section_vaddr + align - 1) & ~(align - 1);
         }
+    };
 
-        uint32_t flags = 0;
-        uint32_t sh_flags = static_cast<uint32_t>(SHF::ALLOC); // 所有段都是ALLOC的
+    // 跳板插入后，后面的节整体后移，可能让更多跳转越界，所以迭代到不再新增跳板为止
+    std::vector<const SymbolDef*> thunk_targets;
+    std::map<const SymbolDef*, size_t> thunk_index;
+
+    for (;;) {
+        layout();
+
+        size_t thunk_count = thunk_targets.size();
+        for (const auto& name : ordered_section_names) {
+            if (!is_code(name) || name == THUNK_SECTION)
+                continue;
+            for (const auto& raw_section : section_groups[name]) {
+                for (size_t k = 0; k != raw_section.section.relocs.size(); ++k) {
+                    const auto& reloc = raw_section.section.relocs[k];
+                    if (reloc.type != RelocationType::R_X86_64_PC32 || reloc.addend != 4
+                        || !is_branch_site(raw_section.section.sites[k]))
+                        continue;
+
+                    // 未定义符号留到重定位阶段报错
+                    const SymbolDef* def = find_symbol(raw_section, reloc.symbol);
+                    if (!def || thunk_index.contains(def))
+                        continue;
+
+                    int64_t value = symbol_offset(*def) + reloc.addend - (raw_section.global_offset + reloc.offset) - 8;
+                    if (!fits_int32(value)) {
+                        thunk_index[def] = thunk_targets.size();
+                        thunk_targets.push_back(def);
+                    }
+                }
+            }
+        }
+
+        if (thunk_targets.size() == thunk_count)
+            break;
+
+        // 跳板节紧跟在最后一个常规代码节之后，离调用者近
+        auto& thunks = section_groups[THUNK_SECTION];
+        if (thunks.empty()) {
+            thunks.push_back({ .name = THUNK_SECTION, .output = THUNK_SECTION, .file_name = "", .object_index = objects.size(), .section = {}, .offset = 0, .global_offset = 0, .patches = {} });
+            auto pos = ordered_section_names.begin();
+            for (auto it = ordered_section_names.begin(); it != ordered_section_names.end(); ++it) {
+                if (is_code(*it) && !is_large_section(*it)) {
+                    pos = std::next(it);
+                }
+            }
+            ordered_section_names.insert(pos, THUNK_SECTION);
+        }
+        thunks.front().section.size = thunk_targets.size() * THUNK_SIZE;
+    }
+
+    // 5. Merge sections and generate program headers
+    //    这里只记录每个输出节由哪些输入节拼成，内容由调用者读入后按计划写出
+    for (auto name : ordered_section_names) {
+        std::cout << "\nMerging section: " << name << std::endl;
+        auto& sections = section_groups[name];
+
+        OutputSection merged_section { .name = name, .size = 0, .bss = is_bss_section(name), .pieces = {}, .synthesized = {} };
+
+        for (auto& raw_section : sections) {
+            // BSS 输入节没有数据（输出节中对应的部分为零），只占位置
+            if (!is_bss_section(raw_section.name) && raw_section.object_index < objects.size()) {
+                merged_section.pieces.push_back(Piece {
+                    .object_index = raw_section.object_index,
+                    .section = raw_section.name,
+                    .offset = raw_section.offset,
+                    .size = raw_section.section.size,
+                    .patches = raw_section.patches,
+                });
+            }
+        }
+        const uint64_t section_size = sections.back().offset + sections.back().section.size;
+        merged_section.size = section_size;
 
-        if (name == ".text" || name.starts_with(".text.")) {
-            flags = static_cast<uint32_t>(PHF::R) | static_cast<uint32_t>(PHF::X);
+        const uint32_t flags = section_flags(name);
+        uint32_t sh_flags = static_cast<uint32_t>(SHF::ALLOC); // 所有段都是ALLOC的
+        if (flags & static_cast<uint32_t>(PHF::X)) {
             sh_flags |= static_cast<uint32_t>(SHF::EXEC);
-        } else if (name == ".rodata" || name.starts_with(".rodata.")) {
-            flags = static_cast<uint32_t>(PHF::R);
-        } else if (name == ".data" || name.starts_with(".data.") || name == ".bss" || name.starts_with(".bss.")) {
-            flags = static_cast<uint32_t>(PHF::R) | static_cast<uint32_t>(PHF::W);
+        }
+        if (flags & static_cast<uint32_t>(PHF::W)) {
             sh_flags |= static_cast<uint32_t>(SHF::WRITE);
         }
-
-        if (name == ".bss" || name.starts_with(".bss.")) {
+        if (is_bss_section(name)) {
             sh_flags |= static_cast<uint32_t>(SHF::NOBITS);
         }
 
-        auto section_size = name == ".bss" ? static_cast<uint32_t>(total_bss_size) : static_cast<uint32_t>(merged_section.data.size());
+        const uint64_t section_vaddr = sections.front().global_offset - sections.front().offset;
 
         // 添加程序头
         result.phdrs.push_back(ProgramHeader {
             .name = name,
-            .vaddr = BASE_VADDR + section_vaddr,
+            .vaddr = section_vaddr,
             .size = section_size,
-            .flags = flags });
+            .flags = flags,
+            .align = segment_align(name) });
 
         // 添加节头
         result.shdrs.push_back(SectionHeader {
             .name = name,
             .type = 1, // SHT_PROGBITS 或 SHT_NOBITS
             .flags = sh_flags,
-            .addr = BASE_VADDR + section_vaddr,
-            .offset = section_vaddr, // 在文件中的偏移，对于BSS段这个值不重要
+            .addr = section_vaddr,
+            .offset = section_vaddr - base, // 在文件中的偏移，对于BSS段这个值不重要
             .size = section_size,
             .addralign = 16 // 默认16字节对齐
         });
 
-        result.sections[name] = merged_section;
-        section_vaddr += section_size;
-        section_vaddr = (section_vaddr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        plan.sections.push_back(std::move(merged_section));
     }
 
-    // 3. Collect all symbols
-    std::map<std::string, Symbol> global_symbols;
-    std::map<std::string, size_t> local_symbols;
-
-    auto local_name_prefix = [](std::string_view obj_name, std::string_view sym_name) {
-        return std::string(obj_name) + "." + std::string(sym_name);
+    auto output_section = [&](const SectionName& name) -> OutputSection& {
+        return *std::find_if(plan.sections.begin(), plan.sections.end(),
+            [&](const OutputSection& section) { return section.name == name; });
     };
 
-    std::cout << "\n=== Phase 2: Processing Symbols ===\n";
-    for (const auto& obj : objects) {
-        for (const auto& sym : obj.symbols) {
-            std::cout << "Symbol: " << sym.name
-                      << " from " << obj.name
-                      << " type=" << (sym.type == SymbolType::LOCAL ? "LOCAL" : sym.type == SymbolType::WEAK ? "WEAK"
-                                                                                                             : "GLOBAL")
-                      << " section=" << sym.section
-                      << " offset=0x" << std::hex << sym.offset << std::dec << std::endl;
-
-            // First, find the section
-            auto offset_it = section_groups.find(sym.section);
-            if (offset_it == section_groups.end()) {
-                throw std::runtime_error("Symbol " + sym.name + " refers to non-existent section " + sym.section);
-            }
-
-            // Second, find the raw section
-            auto raw_section_it = std::find_if(offset_it->second.begin(), offset_it->second.end(),
-                [&](const RawSection& section) { return section.file_name == obj.name; });
-            if (raw_section_it == offset_it->second.end()) {
-                throw std::runtime_error("Symbol " + sym.name + " in " + obj.name + " refers to non-existent section " + sym.section);
-            }
-            size_t symbol_global_offset = raw_section_it->global_offset + sym.offset;
-
-            std::cout << "Symbol " << sym.name << " in " << obj.name << " at offset " << symbol_global_offset << std::endl;
+    // 填写跳板：ff 25 00 00 00 00 = jmp *0(%rip)，其后 8 字节为目标绝对地址
+    if (!thunk_targets.empty()) {
+        std::cout << "\nRange-extension thunks: " << thunk_targets.size() << std::endl;
+        auto& data = output_section(THUNK_SECTION).synthesized;
+        data.assign(thunk_targets.size() * THUNK_SIZE, 0);
+        for (size_t i = 0; i != thunk_targets.size(); ++i) {
+            uint8_t* thunk = data.data() + i * THUNK_SIZE;
+            const uint8_t jmp[] = { 0xff, 0x25, 0x00, 0x00, 0x00, 0x00 };
+            std::copy(std::begin(jmp), std::end(jmp), thunk);
+            const uint64_t target = symbol_offset(*thunk_targets[i]);
+            std::memcpy(thunk + 6, &target, sizeof(target));
+            thunk[14] = thunk[15] = 0xcc; // int3 填充
+        }
+    }
 
-            if (sym.type == SymbolType::LOCAL) {
-                local_symbols[local_name_prefix(obj.name, sym.name)] = symbol_global_offset;
-            } else {
-                auto it = global_symbols.find(sym.name);
-                if (it == global_symbols.end()) {
-                    Symbol new_sym = sym;
-                    new_sym.offset = symbol_global_offset;
-                    global_symbols[sym.name] = new_sym;
-                } else if (sym.type == SymbolType::GLOBAL && it->second.type == SymbolType::GLOBAL) {
-                    throw std::runtime_error("Multiple definition of strong symbol: " + sym.name);
-                } else if (sym.type == SymbolType::GLOBAL && it->second.type == SymbolType::WEAK) {
-                    Symbol new_sym = sym;
-                    new_sym.offset = symbol_global_offset;
-                    it->second = new_sym;
-                }
-            }
+    // GOT 表项在链接时直接填入目标的绝对地址
+    if (!got_entries.empty()) {
+        auto& data = output_section(GOT_SECTION).synthesized;
+        data.assign(got_entries.size() * GOT_ENTRY_SIZE, 0);
+        for (size_t i = 0; i != got_entries.size(); ++i) {
+            const uint64_t target = symbol_offset(*got_entries[i]);
+            std::memcpy(data.data() + i * GOT_ENTRY_SIZE, &target, sizeof(target));
         }
     }
 
     // 第三遍：处理重定位
     std::cout << "\n=== Phase 3: Processing Relocations ===\n";
-    for (const auto& [name, sections] : section_groups) {
+
+    RelocProgram& program = plan.program;
+
+    // 同一目标（直接、经跳板或经 GOT）共用一个槽位
+    enum class Via { DIRECT,
+        THUNK,
+        GOT };
+    std::map<std::pair<const SymbolDef*, Via>, uint32_t> slot_index;
+    auto slot_for = [&](const SymbolDef* def, Via via, int64_t value) {
+        auto [it, inserted] = slot_index.try_emplace({ def, via }, program.slots.size());
+        if (inserted) {
+            program.slots.push_back(RelocSlot { value, def->symbol.name });
+        }
+        return it->second;
+    };
+
+    for (const auto& name : ordered_section_names) {
+        const auto& sections = section_groups[name];
+        const auto section_index = static_cast<uint32_t>(program.sections.size());
+        program.sections.push_back(name);
+        program.section_offsets.push_back(sections.front().global_offset);
+
         for (const auto& raw_section : sections) {
-            auto& section = raw_section.section;
-            for (const auto& reloc : section.relocs) {
+            const auto& section = raw_section.section;
+            for (size_t k = 0; k != section.relocs.size(); ++k) {
+                const auto& reloc = section.relocs[k];
                 size_t reloc_global_offset = raw_section.global_offset + reloc.offset;
 
-                int64_t symbol_value;
-                // First, check if it's a local symbol
-                auto local_it = local_symbols.find(local_name_prefix(raw_section.file_name, reloc.symbol));
-                if (local_it != local_symbols.end()) {
-                    symbol_value = local_it->second;
-                } else {
-                    // Then, check if it's a global symbol
-                    auto global_it = global_symbols.find(reloc.symbol);
-                    if (global_it != global_symbols.end()) {
-                        symbol_value = global_it->second.offset;
-                    } else {
-                        throw std::runtime_error("Undefined symbol: " + reloc.symbol);
-                    }
+                const SymbolDef* def = find_symbol(raw_section, reloc.symbol);
+                if (!def) {
+                    throw std::runtime_error("Undefined symbol: " + reloc.symbol);
                 }
+                int64_t symbol_value = symbol_offset(*def);
 
                 std::cout << "\nRelocation in " << name
                           << " from " << raw_section.file_name << std::endl;
-                std::cout << "  Type: " << (reloc.type == RelocationType::R_X86_64_32 ? "R_X86_64_32" : reloc.type == RelocationType::R_X86_64_PC32 ? "R_X86_64_PC32"
-                        : reloc.type == RelocationType::R_X86_64_32S                                                                                ? "R_X86_64_32S"
-                                                                                                                                                    : "R_X86_64_64")
+                std::cout << "  Type: " << relocation_type_name(reloc.type)
                           << " at offset 0x" << std::hex << reloc_global_offset
                           << " symbol=" << reloc.symbol
                           << " addend=" << reloc.addend << std::dec << std::endl;
 
                 std::cout << "  Symbol value: 0x" << std::hex << symbol_value << std::dec << std::endl;
 
-                // 计算重定位值
-                int64_t value;
+                RelocOp op {
+                    .offset = raw_section.offset + reloc.offset,
+                    .addend = reloc.addend,
+                    .section = section_index,
+                    .slot = 0,
+                    .type = reloc.type,
+                };
                 switch (reloc.type) {
                 case RelocationType::R_X86_64_32:
                 case RelocationType::R_X86_64_32S:
-                    value = BASE_VADDR + symbol_value + reloc.addend;
+                case RelocationType::R_X86_64_64:
+                    op.slot = slot_for(def, Via::DIRECT, symbol_value);
                     break;
                 case RelocationType::R_X86_64_PC32:
-                    value = symbol_value + reloc.addend - reloc_global_offset - 8;
+                    op.slot = slot_for(def, Via::DIRECT, symbol_value);
+                    // 超出 ±2GB 的跳转改为跳到跳板
+                    if (!fits_int32(relocation_value(reloc.type, symbol_value, reloc.addend, reloc_global_offset))
+                        && thunk_index.contains(def) && reloc.addend == 4
+                        && is_code(name) && is_branch_site(section.sites[k])) {
+                        int64_t thunk_offset = section_groups[THUNK_SECTION].front().global_offset
+                            + thunk_index[def] * THUNK_SIZE;
+                        op.slot = slot_for(def, Via::THUNK, thunk_offset);
+                        std::cout << "  Via thunk at: 0x" << std::hex << thunk_offset << std::dec << std::endl;
+                    }
                     break;
-                case RelocationType::R_X86_64_64:
-                    value = BASE_VADDR + symbol_value + reloc.addend;
+                case RelocationType::R_X86_64_GOTPCREL:
+                case RelocationType::R_X86_64_GOTPCRELX:
+                case RelocationType::R_X86_64_REX_GOTPCRELX: {
+                    // GOT 表项地址已知，降级为对表项的 PC32
+                    int64_t got_offset = section_groups[GOT_SECTION].front().global_offset
+                        + got_index.at(def) * GOT_ENTRY_SIZE;
+                    op.slot = slot_for(def, Via::GOT, got_offset);
+                    op.type = RelocationType::R_X86_64_PC32;
                     break;
+                }
                 default:
                     throw std::runtime_error("Unsupported relocation type");
                 }
 
-                std::cout << "  Final value: 0x" << std::hex << value << std::dec << std::endl;
-
-                // 写入重定位值
-                size_t size = (reloc.type == RelocationType::R_X86_64_64) ? 8 : 4;
-                size_t reloc_offset = raw_section.offset + reloc.offset;
+                std::cout << "  Final value: 0x" << std::hex
+                          << relocation_value(op.type, program.slots[op.slot].value, op.addend, reloc_global_offset)
+                          << std::dec << std::endl;
+                program.ops.push_back(op);
+            }
+        }
+    }
 
-                // 检查值是否在合法范围内
-                if (reloc.type == RelocationType::R_X86_64_32) {
-                    // 无符号32位，值必须为正且在uint32范围内
-                    if (value < 0 || value > UINT32_MAX) {
-                        throw std::runtime_error("Relocation value out of range for R_X86_64_32");
-                    }
-                } else if (reloc.type == RelocationType::R_X86_64_32S) {
-                    // 有符号32位，值必须在int32范围内
-                    if (value < INT32_MIN || value > INT32_MAX) {
-                        throw std::runtime_error("Relocation value out of range for R_X86_64_32S");
-                    }
-                }
+    std::sort(program.ops.begin(), program.ops.end(), [](const RelocOp& a, const RelocOp& b) {
+        return std::tie(a.section, a.type, a.offset) < std::tie(b.section, b.type, b.offset);
+    });
+    std::cout << "\nRelocation program: " << program.ops.size() << " relocations, "
+              << program.slots.size() << " targets" << std::endl;
 
-                // 写入值
-                for (size_t i = 0; i != size; ++i) {
-                    result.sections[name].data[reloc_offset + i] = (value >> (i * 8)) & 0xFF;
-                }
+    // --pie：记下所有写入绝对地址的位置。PC 相对的引用在映像整体平移时不变，
+    // 链接器合成的 GOT 表项与跳板目标也是绝对地址
+    if (options.pie) {
+        DynamicRelocs relocs;
+        for (const auto& op : program.ops) {
+            const uint64_t address = program.section_offsets[op.section] + op.offset;
+            switch (op.type) {
+            case RelocationType::R_X86_64_64:
+                relocs.abs64.push_back(address);
+                break;
+            case RelocationType::R_X86_64_32:
+                relocs.abs32.push_back(address);
+                break;
+            case RelocationType::R_X86_64_32S:
+                relocs.abs32s.push_back(address);
+                break;
+            default:
+                break;
             }
         }
+        for (size_t i = 0; i != got_entries.size(); ++i) {
+            relocs.abs64.push_back(section_groups[GOT_SECTION].front().global_offset + i * GOT_ENTRY_SIZE);
+        }
+        for (size_t i = 0; i != thunk_targets.size(); ++i) {
+            relocs.abs64.push_back(section_groups[THUNK_SECTION].front().global_offset + i * THUNK_SIZE + 6);
+        }
+        std::sort(relocs.abs64.begin(), relocs.abs64.end());
+        std::sort(relocs.abs32.begin(), relocs.abs32.end());
+        std::sort(relocs.abs32s.begin(), relocs.abs32s.end());
+        std::cout << "\nDynamic relocations: " << relocs.abs64.size() << " abs64, " << relocs.abs32.size()
+                  << " abs32, " << relocs.abs32s.size() << " abs32s" << std::endl;
+        result.dynamic_relocs = std::move(relocs);
     }
 
     // 设置入口点（_start 符号的位置）
-    auto start_it = global_symbols.find("_start");
-    if (start_it == global_symbols.end()) {
+    const SymbolDef* start = find_global("_start");
+    if (!start) {
         throw std::runtime_error("No _start symbol found");
     }
-    result.entry = BASE_VADDR + start_it->second.offset;
+    result.entry = symbol_offset(*start);
 
-    std::cout << "\n=== Phase 4: Finalizing ===\n";
-    std::cout << "Entry point: 0x" << std::hex << result.entry << std::dec << std::endl;
-    std::cout << "Total size: 0x" << std::hex << result.sections[".text"].data.size() << std::dec << " bytes\n";
+    // 6. 输出符号表：解析结果中的全局符号与（可选的）局部符号，offset 为绝对地址
+    auto emit_symbol = [&](const SymbolDef& def) {
+        result.symbols.push_back(Symbol {
+            .type = def.symbol.type,
+            .section = def.raw->output,
+            .offset = static_cast<size_t>(symbol_offset(def)),
+            .size = def.symbol.size,
+            .name = def.symbol.name,
+        });
+    };
+    std::set<std::string> emitted_globals;
+    for (size_t i = 0; i != objects.size(); ++i) {
+        for (size_t j = 0; j != objects[i].symbols.size(); ++j) {
+            const auto& sym = objects[i].symbols[j];
+            if (!symbol_sections[i][j])
+                continue;
+            if (sym.type != SymbolType::LOCAL) {
+                if (emitted_globals.insert(sym.name).second) {
+                    emit_symbol(*find_global(sym.name));
+                }
+            } else if (!options.discard_locals && sym.name != sym.section && !sym.name.starts_with(".L")) {
+                // 节符号与编译器生成的 .L 标号对符号化没有意义
+                emit_symbol(SymbolDef { sym, symbol_sections[i][j] });
+            }
+        }
+    }
+
+    // 地址索引：按起始地址排序；大小为 0 的符号延伸到下一个符号或段尾
+    for (size_t i = 0; i != result.symbols.size(); ++i) {
+        const auto& sym = result.symbols[i];
+        result.symbol_index.push_back(SymbolIndexEntry { sym.offset, sym.offset + sym.size, i });
+    }
+    std::sort(result.symbol_index.begin(), result.symbol_index.end(), [](const SymbolIndexEntry& a, const SymbolIndexEntry& b) {
+        return std::tie(a.start, a.symbol) < std::tie(b.start, b.symbol);
+    });
+    for (size_t i = 0; i != result.symbol_index.size(); ++i) {
+        auto& entry = result.symbol_index[i];
+        if (entry.end != entry.start)
+            continue;
+        auto phdr = std::find_if(result.phdrs.begin(), result.phdrs.end(), [&](const ProgramHeader& phdr) {
+            return phdr.name == result.symbols[entry.symbol].section;
+        });
+        entry.end = phdr != result.phdrs.end() ? phdr->vaddr + phdr->size : entry.start;
+        for (size_t k = i + 1; k != result.symbol_index.size(); ++k) {
+            if (result.symbol_index[k].start > entry.start) {
+                entry.end = std::min(entry.end, result.symbol_index[k].start);
+                break;
+            }
+        }
+    }
+    std::cout << "\nSymbol table: " << result.symbols.size() << " symbols" << std::endl;
+
+    return plan;
+}
+
+// 只检查重定位值的范围、不写回，--plan 借此在不读节内容的情况下发现布局越界
+template <RelocationType Type>
+void verify_relocations(std::span<const RelocOp> ops, uint64_t section_offset, const std::vector<RelocSlot>& slots)
+{
+    for (const auto& op : ops) {
+        if (!relocation_in_range<Type>(relocation_value(Type, slots[op.slot].value, op.addend, section_offset + op.offset))) {
+            relocation_out_of_range<Type>(op, slots);
+        }
+    }
+}
+
+void verify_relocation_program(const RelocProgram& program)
+{
+    for (auto begin = program.ops.begin(); begin != program.ops.end();) {
+        auto end = std::find_if(begin, program.ops.end(),
+            [&](const RelocOp& op) { return op.section != begin->section || op.type != begin->type; });
+        const std::span<const RelocOp> ops(begin, end);
+        const uint64_t section_offset = program.section_offsets[begin->section];
+        switch (begin->type) {
+        case RelocationType::R_X86_64_PC32:
+            verify_relocations<RelocationType::R_X86_64_PC32>(ops, section_offset, program.slots);
+            break;
+        case RelocationType::R_X86_64_32:
+            verify_relocations<RelocationType::R_X86_64_32>(ops, section_offset, program.slots);
+            break;
+        case RelocationType::R_X86_64_32S:
+            verify_relocations<RelocationType::R_X86_64_32S>(ops, section_offset, program.slots);
+            break;
+        case RelocationType::R_X86_64_64:
+            break;
+        default:
+            throw std::runtime_error("Unsupported relocation type");
+        }
+        begin = end;
+    }
+}
+
+// 已加载的目标文件大致占用的内存：节内容、重定位与符号
+uint64_t object_footprint(const FLEObject& obj)
+{
+    uint64_t bytes = sizeof(FLEObject);
+    for (const auto& [name, section] : obj.sections) {
+        bytes += sizeof(FLESection) + name.size() + section.data.size() + section.relocs.size() * sizeof(Relocation);
+        for (const auto& reloc : section.relocs) {
+            bytes += reloc.symbol.size();
+        }
+    }
+    for (const auto& sym : obj.symbols) {
+        bytes += sizeof(Symbol) + sym.name.size() + sym.section.size();
+    }
+    return bytes;
+}
+
+uint64_t section_data_size(const FLEObject& obj)
+{
+    uint64_t bytes = 0;
+    for (const auto& [name, section] : obj.sections) {
+        bytes += section.data.size();
+    }
+    return bytes;
+}
 
+std::string format_size(uint64_t bytes)
+{
+    std::ostringstream out;
+    if (bytes < 1024) {
+        out << bytes << " B";
+    } else {
+        out << std::fixed << std::setprecision(1);
+        if (bytes < 1024 * 1024) {
+            out << bytes / 1024.0 << " KiB";
+        } else {
+            out << bytes / (1024.0 * 1024.0) << " MiB";
+        }
+    }
+    return out.str();
+}
+
+// 在作用域内丢弃 std::cout 的输出
+class SilenceStdout {
+public:
+    SilenceStdout()
+        : saved(std::cout.rdbuf(&sink))
+    {
+    }
+    ~SilenceStdout() { std::cout.rdbuf(saved); }
+
+private:
+    struct NullBuffer : std::streambuf {
+        int overflow(int c) override { return c; }
+    };
+    NullBuffer sink;
+    std::streambuf* saved;
+};
+
+} // anonymous namespace
+
+FLEObject FLE_ld(const std::vector<FLEObject>& objects, const LinkOptions& options)
+{
+    std::vector<const FLEObject*> pointers;
+    for (const auto& obj : objects) {
+        pointers.push_back(&obj);
+    }
+    return FLE_ld(pointers, options);
+}
+
+FLEObject FLE_ld(const std::vector<const FLEObject*>& objects, const LinkOptions& options)
+{
+    std::vector<ObjectInfo> infos;
+    infos.reserve(objects.size());
+    for (const auto* obj : objects) {
+        infos.push_back(describe_object(*obj));
+    }
+    LinkPlan plan = plan_link(infos, options);
+
+    FLEObject result = plan.result;
+    BuildIdHasher build_id(worker_count(options));
+    for (size_t i = 0; i != plan.sections.size(); ++i) {
+        const auto& output = plan.sections[i];
+        FLESection merged_section;
+
+        if (output.bss) {
+            merged_section.bss_size = output.size;
+        } else if (!output.synthesized.empty()) {
+            merged_section.data = output.synthesized;
+        } else {
+            merged_section.data.resize(output.size);
+            for (const auto& piece : output.pieces) {
+                const auto& data = objects[piece.object_index]->sections.at(piece.section).data;
+                std::span<uint8_t> dst(merged_section.data.data() + piece.offset, piece.size);
+                std::copy(data.begin(), data.end(), dst.begin());
+                apply_patches(dst, piece);
+            }
+        }
+
+        apply_relocation_window(plan.program, i, 0, merged_section.data);
+        const auto& data = (result.sections[output.name] = std::move(merged_section)).data;
+
+        // 与流式链接相同，按输入块（合成节整体算一块）切分叶子
+        if (output.bss) {
+            continue;
+        }
+        if (!output.synthesized.empty()) {
+            build_id.add(i, 0, data);
+            continue;
+        }
+        for (const auto& piece : output.pieces) {
+            build_id.add(i, piece.offset, std::span(data).subspan(piece.offset, piece.size));
+        }
+    }
+    result.build_id = build_id.finish(result);
+
+    finish_link(plan, options, result.build_id);
     return result;
-}
\ No newline at end of file
+}
+
+void FLE_ld_stream(const std::vector<std::string>& inputs, const std::string& outfile, const LinkOptions& options)
+{
+    // 第一遍：逐个扫描输入，只留下链接所需的元数据。
+    // ELF 输入只读头部、符号表与重定位；FLE 是 JSON，只能整个文件解析后再释放
+    std::vector<ObjectInfo> infos;
+    infos.reserve(inputs.size());
+    for (const auto& file : inputs) {
+        if (is_elf_file(file)) {
+            ElfObjectReader reader(file);
+            infos.push_back(describe_object(reader));
+        } else {
+            infos.push_back(describe_object(load_fle(file)));
+        }
+    }
+    LinkPlan plan = plan_link(infos, options);
+
+    std::ofstream out(outfile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot open output file: " + outfile);
+    }
+    // build-id 要等全部内容写完才知道，先写同样长度的占位，最后重写头部
+    plan.result.build_id.assign(BUILD_ID_LENGTH, '0');
+    const auto segments = write_elf_headers(plan.result, out);
+
+    BuildIdHasher build_id(worker_count(options));
+    auto write_at = [&](uint32_t section, uint64_t offset, std::span<uint8_t> data) {
+        apply_relocation_window(plan.program, section, offset, data);
+        out.seekp(segments[section].offset + offset);
+        out.write(reinterpret_cast<const char*>(data.data()), data.size());
+        build_id.add_buffered(section, offset, data);
+    };
+
+    // 合成节直接写出，输入节按所属目标文件归类
+    std::vector<std::vector<std::pair<uint32_t, size_t>>> object_pieces(inputs.size());
+    for (uint32_t i = 0; i != plan.sections.size(); ++i) {
+        auto& output = plan.sections[i];
+        if (output.bss) {
+            continue;
+        }
+        if (!output.synthesized.empty()) {
+            write_at(i, 0, output.synthesized);
+            continue;
+        }
+        for (size_t j = 0; j != output.pieces.size(); ++j) {
+            object_pieces[output.pieces[j].object_index].emplace_back(i, j);
+        }
+    }
+
+    // 第二遍：各节打补丁、重定位后直接写到最终的文件偏移，写完即释放。
+    // ELF 输入逐节读取，内存峰值由最大的单个节决定；FLE 输入整个再加载一次，
+    // 峰值由最大的单个 FLE 文件决定
+    uint64_t largest_section = 0;
+    size_t streamed_sections = 0;
+    auto emit = [&](uint32_t section, const Piece& piece, std::vector<uint8_t>& data, const std::string& file) {
+        if (data.size() != piece.size) {
+            throw std::runtime_error("Input changed during streaming link: " + file);
+        }
+        apply_patches(data, piece);
+        write_at(section, piece.offset, data);
+        largest_section = std::max(largest_section, piece.size);
+        ++streamed_sections;
+        std::vector<uint8_t>().swap(data);
+    };
+    for (size_t i = 0; i != inputs.size(); ++i) {
+        if (object_pieces[i].empty()) {
+            continue;
+        }
+        if (is_elf_file(inputs[i])) {
+            ElfObjectReader reader(inputs[i]);
+            for (const auto& [section, index] : object_pieces[i]) {
+                const auto& piece = plan.sections[section].pieces[index];
+                if (reader.section_size(piece.section) != piece.size) {
+                    throw std::runtime_error("Input changed during streaming link: " + inputs[i]);
+                }
+                auto data = reader.read(piece.section, 0, piece.size);
+                emit(section, piece, data, inputs[i]);
+            }
+            continue;
+        }
+        FLEObject obj = load_fle(inputs[i]);
+        for (const auto& [section, index] : object_pieces[i]) {
+            const auto& piece = plan.sections[section].pieces[index];
+            emit(section, piece, obj.sections.at(piece.section).data, inputs[i]);
+        }
+    }
+
+    plan.result.build_id = build_id.finish(plan.result);
+    write_elf_headers(plan.result, out);
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Failed to write output file: " + outfile);
+    }
+    mark_executable(outfile);
+
+    std::cout << "\nStreamed " << streamed_sections << " sections from " << inputs.size()
+              << " objects, largest section 0x" << std::hex << largest_section << std::dec << " bytes" << std::endl;
+    finish_link(plan, options, plan.result.build_id);
+}
+
+void FLE_ld_plan(const std::vector<std::string>& inputs, const ObjectLoader& load, const LinkOptions& options)
+{
+    std::vector<ObjectInfo> infos;
+    infos.reserve(inputs.size());
+    uint64_t inputs_footprint = 0, metadata_footprint = 0, largest_input = 0;
+    LinkPlan plan;
+    {
+        // 规划过程的逐项日志对 dry run 没有意义，只输出最后的报告
+        SilenceStdout silence;
+        for (const auto& file : inputs) {
+            const auto loaded = load(file);
+            const FLEObject& obj = *loaded;
+            const uint64_t footprint = object_footprint(obj);
+            inputs_footprint += footprint;
+            metadata_footprint += footprint - section_data_size(obj);
+            largest_input = std::max(largest_input, footprint);
+            infos.push_back(describe_object(obj));
+        }
+        plan = plan_link(infos, options);
+        verify_relocation_program(plan.program);
+    }
+
+    auto permissions = [](uint32_t flags) {
+        std::string perms = "---";
+        if (flags & static_cast<uint32_t>(PHF::R))
+            perms[0] = 'r';
+        if (flags & static_cast<uint32_t>(PHF::W))
+            perms[1] = 'w';
+        if (flags & static_cast<uint32_t>(PHF::X))
+            perms[2] = 'x';
+        return perms;
+    };
+
+    std::cout << "=== Link Plan (no output written) ===\n\nAddress map:\n";
+    uint64_t file_bytes = 0, memory_bytes = 0;
+    for (size_t i = 0; i != plan.sections.size(); ++i) {
+        const auto& section = plan.sections[i];
+        const auto& phdr = plan.result.phdrs[i];
+        std::cout << std::hex << std::setfill('0')
+                  << "  0x" << std::setw(16) << phdr.vaddr << " - 0x" << std::setw(16) << phdr.vaddr + phdr.size
+                  << std::setfill(' ') << "  " << permissions(phdr.flags) << "  " << std::left << std::setw(16) << section.name
+                  << std::right << " 0x" << section.size << (section.bss ? " (bss)" : "") << std::dec << "\n";
+        for (const auto& piece : section.pieces) {
+            std::cout << std::hex << "      0x" << std::setfill('0') << std::setw(16) << phdr.vaddr + piece.offset
+                      << std::setfill(' ') << "  0x" << std::left << std::setw(8) << piece.size << std::right << std::dec
+                      << "  " << infos[piece.object_index].name << "(" << piece.section << ")\n";
+        }
+        if (!section.synthesized.empty()) {
+            std::cout << std::hex << "      0x" << std::setfill('0') << std::setw(16) << phdr.vaddr
+                      << std::setfill(' ') << "  0x" << std::left << std::setw(8) << section.size << std::right << std::dec
+                      << "  <linker>\n";
+        }
+        memory_bytes += section.size;
+        if (!section.bss) {
+            file_bytes += section.size;
+        }
+    }
+
+    const uint64_t program_footprint = plan.program.ops.size() * sizeof(RelocOp)
+        + plan.program.slots.size() * sizeof(RelocSlot);
+    std::cout << "\nSegments: " << plan.sections.size()
+              << "\nEntry point: 0x" << std::hex << plan.result.entry << std::dec
+              << "\nFile data: " << format_size(file_bytes) << ", memory image: " << format_size(memory_bytes)
+              << "\nSymbols: " << plan.result.symbols.size()
+              << "\nRelocations: " << plan.program.ops.size() << " (" << plan.program.slots.size() << " targets)"
+              << "\nEstimated peak memory: " << format_size(inputs_footprint + file_bytes + program_footprint)
+              << " in memory, " << format_size(metadata_footprint + largest_input + program_footprint)
+              << " with --stream" << std::endl;
+}
@@ -15,6 +15,9 @@ void print_fle_info(const FLEObject& obj)
     std::cout << "Sections: " << obj.sections.size() << std::endl;
     std::cout << "Symbols: " << obj.symbols.size() << std::endl;
     std::cout << "Relocations: " << total_relocs << std::endl;
+    if (!obj.build_id.empty()) {
+        std::cout << "Build ID: " << obj.build_id << std::endl;
+    }
     std::cout << std::endl;
 
     // 打印节信息
@@ -0,0 +1,15 @@
+#include "minilibc.h"
+
+// 没有初值的全局变量在 -fcommon 下是 COMMON 符号，由链接器分配到 .bss
+int counter;
+long table[4];
+
+int get_value(void);
+
+int main()
+{
+    counter = get_value();
+    table[3] = 42;
+    printf("%d\n", counter + (int)table[3]);
+    return counter + (int)table[3];
+}
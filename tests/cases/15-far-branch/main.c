@@ -0,0 +1,19 @@
+#include "minilibc.h"
+
+// 3 GiB 的大数组：-mcmodel=medium 下放入 .lbss，布局在 32 位地址窗口之外
+char big_table[3UL << 30];
+
+// 放在大代码节中的函数，与调用者相距超过 2 GiB，只能经由跳板调用
+__attribute__((section(".ltext"), noinline)) int far_add(int a, int b)
+{
+    return a + b;
+}
+
+int main()
+{
+    big_table[0] = 40;
+    big_table[sizeof(big_table) - 1] = 2;
+    int value = far_add(big_table[0], big_table[sizeof(big_table) - 1]);
+    printf("%d\n", value);
+    return value;
+}
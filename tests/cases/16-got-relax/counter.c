@@ -0,0 +1,10 @@
+#include "minilibc.h"
+
+int counter = 40;
+
+// 以 -Wa,-mrelax-relocations=no 编译：对 counter 的访问是不可松弛的
+// R_X86_64_GOTPCREL，链接器需要为它分配 .got 表项
+void bump(void)
+{
+    counter++;
+}
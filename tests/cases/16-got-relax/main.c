@@ -0,0 +1,17 @@
+#include "minilibc.h"
+
+extern int counter;
+void bump(void);
+
+// -fPIC 下对外部符号的访问都经由 GOT（R_X86_64_REX_GOTPCRELX），
+// 链接器应把 mov foo@GOTPCREL(%rip) 松弛为 lea foo(%rip)
+void (*volatile hook)(void);
+
+int main()
+{
+    hook = bump;
+    hook();
+    bump();
+    printf("%d\n", counter);
+    return counter;
+}
@@ -0,0 +1,3 @@
+#include "magic.h"
+
+int from_a(void) { return get_magic(); }
@@ -0,0 +1,14 @@
+#pragma once
+
+// 模拟 C++ inline 函数/模板实例化：每个包含本头文件的目标文件
+// 都带一份 get_magic 的 COMDAT 节组，链接时只能保留一份
+asm(".section .text.get_magic,\"axG\",@progbits,get_magic,comdat\n"
+    ".globl get_magic\n"
+    ".type get_magic, @function\n"
+    "get_magic:\n"
+    "    movl $21, %eax\n"
+    "    ret\n"
+    ".size get_magic, .-get_magic\n"
+    ".text\n");
+
+int get_magic(void);
@@ -0,0 +1,11 @@
+#include "minilibc.h"
+
+int from_a(void);
+int from_b(void);
+
+int main()
+{
+    int result = from_a() + from_b();
+    printf("%d\n", result);
+    return result;
+}
@@ -0,0 +1,12 @@
+#include "minilibc.h"
+
+extern int table[4];
+int sum_table(void);
+
+int main()
+{
+    table[0] += 10;
+    int result = sum_table() + table[3];
+    printf("%d\n", result);
+    return result;
+}
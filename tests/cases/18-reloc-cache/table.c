@@ -0,0 +1,11 @@
+int table[4] = { 3, 5, 7, 9 };
+int* table_ptr = table; // R_X86_64_64
+
+int sum_table(void)
+{
+    int sum = 0;
+    for (int i = 0; i < 4; i++) {
+        sum += table_ptr[i];
+    }
+    return sum;
+}
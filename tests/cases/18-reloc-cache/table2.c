@@ -0,0 +1,12 @@
+int table[4] = { 3, 5, 7, 9 };
+int* table_ptr = table; // R_X86_64_64
+int step = 1; // extra symbol shifts the .data layout
+
+int sum_table(void)
+{
+    int sum = 0;
+    for (int i = 0; i < 4; i++) {
+        sum += table_ptr[i] + step;
+    }
+    return sum;
+}
@@ -0,0 +1,11 @@
+#include "minilibc.h"
+
+extern const int table[];
+extern const int* const table_end;
+
+int main()
+{
+    int result = table[0] + *table_end;
+    printf("%d\n", result);
+    return result;
+}
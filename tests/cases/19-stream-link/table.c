@@ -0,0 +1,6 @@
+// 模拟生成的大数据表：大部分为 0，但仍占用文件空间
+const int table[1 << 16] = {
+    [0] = 10,
+    [(1 << 16) - 1] = 32,
+};
+const int* const table_end = &table[(1 << 16) - 1]; // R_X86_64_64
@@ -0,0 +1,4 @@
+int fib(int n)
+{
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
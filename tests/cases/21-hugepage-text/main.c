@@ -0,0 +1,10 @@
+#include "minilibc.h"
+
+int fib(int n);
+
+int main()
+{
+    int result = fib(10);
+    printf("fib(10) = %d\n", result);
+    return result;
+}
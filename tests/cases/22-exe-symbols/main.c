@@ -0,0 +1,16 @@
+#include "minilibc.h"
+
+int counter = 5;
+
+// 局部函数：只有在保留局部符号时才出现在输出的符号表中
+static __attribute__((noinline)) int twice(int x)
+{
+    return x * 2;
+}
+
+int main()
+{
+    int result = twice(counter) + 1;
+    printf("%d\n", result);
+    return result;
+}
@@ -0,0 +1,14 @@
+#include "minilibc.h"
+
+// 跨多个哈希块的只读数据
+const int squares[1 << 15] = {
+    [3] = 9,
+    [(1 << 15) - 1] = 21,
+};
+
+int main()
+{
+    int result = squares[3] + squares[(1 << 15) - 1];
+    printf("%d\n", result);
+    return result;
+}
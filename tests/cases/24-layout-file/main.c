@@ -0,0 +1,15 @@
+#include "minilibc.h"
+
+// 热数据单独成节，由布局文件放在代码段之后
+__attribute__((section(".data.hot"))) int hits = 3;
+__attribute__((section(".data.hot"))) int misses = 4;
+
+int cold_table[16] = { 1, 2, 3 };
+int scratch[64];
+
+int main()
+{
+    scratch[0] = hits * 10 + misses;
+    printf("%d\n", scratch[0] + cold_table[2]);
+    return scratch[0];
+}
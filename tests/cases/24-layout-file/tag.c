@@ -0,0 +1,2 @@
+// 节名看不出权限，布局文件又没给 FLAGS
+__attribute__((section(".tag"))) int tag = 1;
@@ -0,0 +1,11 @@
+#include "minilibc.h"
+
+extern int scale(int x);
+int samples[1024];
+
+int main()
+{
+    samples[7] = scale(6);
+    printf("%d\n", samples[7]);
+    return 0;
+}
@@ -0,0 +1,6 @@
+int factor = 7;
+
+int scale(int x)
+{
+    return x * factor;
+}
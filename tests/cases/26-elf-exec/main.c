@@ -0,0 +1,13 @@
+#include "minilibc.h"
+
+// 可写数据与 BSS：映射自文件的页写时复制，不能改动文件本身
+int counter = 40;
+int buffer[2048];
+
+int main()
+{
+    counter += 2;
+    buffer[2047] = counter;
+    printf("mapped %d\n", buffer[2047]);
+    return buffer[2047];
+}
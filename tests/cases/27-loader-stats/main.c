@@ -0,0 +1,17 @@
+#include "minilibc.h"
+
+// 代码、只读数据、数据与 BSS 各占一个段，加载器只应预留一次地址空间
+const int table[4] = { 1, 2, 3, 4 };
+int scale = 3;
+int scratch[1024];
+
+int main()
+{
+    int sum = 0;
+    for (int i = 0; i < 4; i++) {
+        scratch[i * 256] = table[i] * scale;
+        sum += scratch[i * 256];
+    }
+    printf("sum %d\n", sum);
+    return sum;
+}
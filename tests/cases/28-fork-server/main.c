@@ -0,0 +1,21 @@
+#include "minilibc.h"
+
+// 每次运行都从初始状态开始：runs 总是 1
+int runs;
+
+int main()
+{
+    char buf[32];
+    long n = syscall(SYS_read, 0, buf, sizeof(buf));
+    if (n <= 0 || buf[0] < '0' || buf[0] > '9') {
+        syscall(SYS_write, 2, "not a number\n", 13);
+        return 2;
+    }
+    int value = 0;
+    for (long i = 0; i < n && buf[i] >= '0' && buf[i] <= '9'; i++) {
+        value = value * 10 + buf[i] - '0';
+    }
+    runs++;
+    printf("%d squared is %d (run %d)\n", value, value * value, runs);
+    return value;
+}
@@ -0,0 +1,12 @@
+int weights[4] = { 2, 3, 5, 7 };
+static int calls;
+
+int dot(const int* values)
+{
+    int sum = 0;
+    for (int i = 0; i < 4; i++) {
+        sum += values[i] * weights[i];
+    }
+    calls++;
+    return sum + calls - 1;
+}
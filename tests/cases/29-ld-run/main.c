@@ -0,0 +1,12 @@
+#include "minilibc.h"
+
+extern int weights[4];
+int dot(const int* values);
+
+int main()
+{
+    int values[4] = { 1, 2, 3, 4 };
+    int result = dot(values);
+    printf("dot %d\n", result);
+    return result;
+}
@@ -0,0 +1,27 @@
+#include "minilibc.h"
+
+// hot 占去几乎全部 CPU 时间，其中约五分之一经由 cold 调用
+__attribute__((noinline)) int hot(int n)
+{
+    volatile int x = 0;
+    for (int i = 0; i < n; i++) {
+        x = x * 31 + i;
+    }
+    return x;
+}
+
+__attribute__((noinline)) int cold(int n)
+{
+    return hot(n / 4);
+}
+
+int main()
+{
+    int sum = 0;
+    for (int round = 0; round < 20; round++) {
+        sum += hot(10000000);
+        sum += cold(10000000);
+    }
+    printf("done %d\n", sum != 0);
+    return 0;
+}
@@ -0,0 +1,15 @@
+#include "minilibc.h"
+
+// 每 4 KiB 写一次，BSS 页在首次写入时缺页
+char pages[64 * 4096];
+
+int main()
+{
+    int sum = 0;
+    for (int i = 0; i < 64; i++) {
+        pages[i * 4096] = (char)i;
+        sum += pages[i * 4096];
+    }
+    printf("sum %d\n", sum);
+    return sum % 256;
+}
@@ -0,0 +1,20 @@
+#include "minilibc.h"
+
+int lines;
+int count = 5;
+
+// print 的每个字符串都是一次 write；调用之后还有事要做，避免被优化成尾调用
+__attribute__((noinline)) void log_line(int i)
+{
+    print("line ", i % 2 ? "odd" : "even", "\n", NULL);
+    lines++;
+}
+
+int main()
+{
+    for (int i = 0; i < count; i++) {
+        log_line(i);
+    }
+    printf("done\n");
+    return 0;
+}
@@ -0,0 +1,24 @@
+#include "minilibc.h"
+
+static int square(int x) { return x * x; }
+static int twice(int x) { return x + x; }
+static int negate(int x) { return -x; }
+
+// 函数指针表与指向全局数据的指针在映像中存放的都是绝对地址
+int (*ops[])(int) = { square, twice, negate };
+int values[] = { 3, 4, 5 };
+int* cursor = &values[1];
+const char* names[] = { "square", "twice", "negate" };
+
+int main()
+{
+    int sum = 0;
+    for (int i = 0; i < 3; i++) {
+        int result = ops[i](*cursor);
+        print(names[i], ": ", NULL);
+        printf("%d\n", result);
+        sum += result;
+    }
+    printf("sum %d\n", sum);
+    return sum;
+}
@@ -0,0 +1,13 @@
+#include "minilibc.h"
+
+// 每次运行都装入一份新的映像，计数总是从 0 开始
+int runs;
+const char* label = "count ";
+
+int main()
+{
+    runs++;
+    print(label, NULL);
+    printf("%d\n", runs);
+    return 0;
+}
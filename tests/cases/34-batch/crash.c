@@ -0,0 +1,10 @@
+#include "minilibc.h"
+
+int* volatile target;
+
+int main()
+{
+    print("crashing\n", NULL);
+    *target = 1;
+    return 0;
+}
@@ -0,0 +1,7 @@
+#include "minilibc.h"
+
+int main()
+{
+    print("failing\n", NULL);
+    return 3;
+}